@@ -0,0 +1,375 @@
+#include "args.h"
+#include "colormap.h"
+#include "noiseimg.h"
+#include "out.h"
+#include "simd.h"
+#include "util.h"
+#include "FastNoiseLite.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static void help() {
+    std::printf("noise-bench\n");
+    std::printf("usage:\n");
+    std::printf("  noise-bench [options]\n\n");
+    std::printf("  --filter <substr> (only benchmarks whose name contains it)\n");
+    std::printf("  --list (print the benchmark names and exit)\n");
+    std::printf("  --min-time <seconds> (default 0.3; per benchmark)\n");
+    std::printf("  --size <int> (default 1024; image side of full renders)\n");
+    std::printf("  --threads <int> (default 1; for full renders)\n");
+    std::printf("  --json <path.jsonl> (one JSON object per benchmark)\n");
+    std::printf("  --compare <base.jsonl> (flag benchmarks slower than the baseline)\n");
+    std::printf("  --against <cur.jsonl> (with --compare: compare two stored runs, run nothing)\n");
+    std::printf("  --threshold <percent> (default 10)\n");
+}
+
+struct Res {
+    std::string name;
+    double mpix = 0.0;
+    double ms = 0.0;
+};
+
+struct Bench {
+    std::string name;
+    double px;  // points (or pixels) per iteration
+    std::function<void()> f;
+};
+
+// Best time per iteration over runs totalling at least `min` seconds, after one warm-up.
+static Res run(const Bench& b, double min) {
+    using clk = std::chrono::steady_clock;
+    b.f();
+    double best = 1e30, tot = 0.0;
+    int n = 0;
+    while (tot < min || n < 3) {
+        auto t0 = clk::now();
+        b.f();
+        double s = std::chrono::duration<double>(clk::now() - t0).count();
+        best = std::min(best, s);
+        tot += s;
+        n++;
+    }
+    Res r;
+    r.name = b.name;
+    r.ms = best * 1e3;
+    r.mpix = b.px / best * 1e-6;
+    return r;
+}
+
+static const int gw = 512;
+
+// A gw x gw grid of pixel coordinates, row by row.
+struct Grid {
+    std::vector<float> x, y, z, w, out, dx, dy;
+
+    Grid() {
+        size_t n = (size_t) gw * gw;
+        x.resize(n);
+        y.resize(n);
+        z.assign(n, 3.5f);
+        w.assign(n, 1.25f);
+        out.resize(n);
+        dx.resize(n);
+        dy.resize(n);
+        for (int j = 0; j < gw; j++) {
+            for (int i = 0; i < gw; i++) {
+                x[(size_t) j * gw + i] = (float) i;
+                y[(size_t) j * gw + i] = (float) j;
+            }
+        }
+    }
+};
+
+static const char* types[] = {"OpenSimplex2", "OpenSimplex2S", "Cellular", "Perlin", "ValueCubic", "Value"};
+
+static FastNoiseLite noise(int t, FastNoiseLite::FractalType f = FastNoiseLite::FractalType_None) {
+    FastNoiseLite n;
+    n.SetNoiseType((FastNoiseLite::NoiseType) t);
+    n.SetFrequency(0.01f);
+    n.SetFractalType(f);
+    return n;
+}
+
+static std::vector<Isa> isas() {
+    std::vector<Isa> v = {Isa::Scalar};
+    if ((int) isa_best() >= (int) Isa::Sse41) {
+        v.push_back(Isa::Sse41);
+    }
+    if (isa_best() == Isa::Avx2) {
+        v.push_back(Isa::Avx2);
+    }
+    return v;
+}
+
+static void micro(std::vector<Bench>& bs, Grid& g, const std::string& tmp) {
+    double px = (double) gw * gw;
+    int n = gw * gw;
+    for (int t = 0; t < 6; t++) {
+        FastNoiseLite fn = noise(t);
+        bs.push_back({std::string("getnoise/") + types[t], px, [&g, fn, n]() {
+                          for (int i = 0; i < n; i++) {
+                              g.out[(size_t) i] = fn.GetNoise(g.x[(size_t) i], g.y[(size_t) i]);
+                          }
+                      }});
+        for (Isa isa : isas()) {
+            bs.push_back({std::string("batch/") + types[t] + "/" + isa_name(isa), px,
+                          [&g, fn, n, isa]() { noise_batch(fn, g.x.data(), g.y.data(), g.out.data(), n, isa); }});
+        }
+        bs.push_back({std::string("row/") + types[t], px, [&g, fn]() {
+                          for (int j = 0; j < gw; j++) {
+                              size_t o = (size_t) j * gw;
+                              noise_row(fn, g.x.data() + o, g.y.data() + o, g.out.data() + o, gw, isa_best());
+                          }
+                      }});
+        bs.push_back({std::string("batch3/") + types[t], px, [&g, fn, n]() {
+                          noise_batch(fn, g.x.data(), g.y.data(), g.z.data(), g.out.data(), n, isa_best());
+                      }});
+    }
+    for (int t : {0, 1, 3, 5}) {
+        FastNoiseLite fn = noise(t);
+        bs.push_back({std::string("batch4/") + types[t], px, [&g, fn, n]() {
+                          noise_batch(fn, g.x.data(), g.y.data(), g.z.data(), g.w.data(), g.out.data(), n, isa_best());
+                      }});
+    }
+    const std::pair<const char*, FastNoiseLite::FractalType> fr[] = {
+        {"FBm", FastNoiseLite::FractalType_FBm},
+        {"Ridged", FastNoiseLite::FractalType_Ridged},
+        {"PingPong", FastNoiseLite::FractalType_PingPong},
+    };
+    for (const auto& f : fr) {
+        FastNoiseLite fn = noise(FastNoiseLite::NoiseType_Perlin, f.second);
+        bs.push_back({std::string("fractal/") + f.first + "/Perlin", px,
+                      [&g, fn, n]() { noise_batch(fn, g.x.data(), g.y.data(), g.out.data(), n, isa_best()); }});
+    }
+    const std::pair<const char*, FastNoiseLite::DomainWarpType> wt[] = {
+        {"OpenSimplex2", FastNoiseLite::DomainWarpType_OpenSimplex2},
+        {"OpenSimplex2Reduced", FastNoiseLite::DomainWarpType_OpenSimplex2Reduced},
+        {"BasicGrid", FastNoiseLite::DomainWarpType_BasicGrid},
+    };
+    for (const auto& w : wt) {
+        FastNoiseLite fn;
+        fn.SetFrequency(0.01f);
+        fn.SetDomainWarpType(w.second);
+        bs.push_back({std::string("warp/") + w.first, px,
+                      [&g, fn, n]() { warp_batch(fn, 0, g.x.data(), g.y.data(), g.dx.data(), g.dy.data(), n, isa_best()); }});
+    }
+    auto lut = std::make_shared<std::vector<uint32_t>>(Colormap::parse("turbo").bake());
+    auto rgb = std::make_shared<std::vector<uint8_t>>((size_t) n * 3u);
+    for (int i = 0; i < n; i++) {
+        g.out[(size_t) i] = std::sin((float) i * 0.001f);
+    }
+    for (Isa isa : isas()) {
+        bs.push_back({std::string("colorize/") + isa_name(isa), px,
+                      [&g, lut, rgb, n, isa]() { colorize(g.out.data(), n, Norm::fixed(), lut->data(), rgb->data(), isa); }});
+    }
+    auto pal = std::make_shared<Palette>();
+    Palette::of(Colormap::parse("grayscale").bake().data(), *pal);
+    auto gray = std::make_shared<std::vector<uint8_t>>((size_t) n);
+    for (Isa isa : isas()) {
+        bs.push_back({std::string("colorize-index/") + isa_name(isa), px,
+                      [&g, pal, gray, n, isa]() { colorize_index(g.out.data(), n, Norm::fixed(), pal->ix.data(), gray->data(), isa); }});
+    }
+    for (const char* f : {"png", "ppm", "jpg"}) {
+        std::string path = tmp + "/bench." + f;
+        std::string fmt = f;
+        bs.push_back({std::string("write/") + f, px, [rgb, path, fmt]() {
+                          std::unique_ptr<ImageOut> o = ImageOut::open(path, fmt, gw, gw, OutOpt());
+                          o->rows(rgb->data(), gw);
+                          o->finish();
+                      }});
+    }
+    bs.push_back({"write/png-gray", px, [gray, pal, tmp]() {
+                      OutOpt oo;
+                      oo.pal = pal.get();
+                      std::unique_ptr<ImageOut> o = ImageOut::open(tmp + "/bench-gray.png", "png", gw, gw, oo);
+                      o->rows(gray->data(), gw);
+                      o->finish();
+                  }});
+    for (const char* k : {"csv", "raw", "npy"}) {
+        std::string path = tmp + "/bench." + k;
+        std::string kind = k;
+        bs.push_back({std::string("write/") + k, px, [&g, path, kind]() {
+                          std::unique_ptr<FieldOut> o = FieldOut::open(path, kind, gw, gw, Norm::fixed(), OutOpt());
+                          o->rows(g.out.data(), gw);
+                          o->finish();
+                      }});
+    }
+}
+
+// Full renders through the generator, so every stage of the pipeline (and process start)
+// is in the number.
+static void macro(std::vector<Bench>& bs, const std::string& tmp, int size, int threads) {
+    const std::pair<const char*, const char*> cs[] = {
+        {"default", ""},
+        {"fbm", "--fractal-type FBm"},
+        {"ridged", "--fractal-type Rigid"},
+        {"cellular", "--type Cellular"},
+        {"3d", "--z 3.5"},
+        {"warp-fused", "--warp --warp-fractal-type DomainWarpProgressive --warp-engine fused"},
+        {"warp-legacy", "--warp --warp-fractal-type DomainWarpProgressive"},
+        {"tile-blend", "--tile"},
+        {"tile-torus", "--tile --tile-mode torus"},
+        {"minmax", "--normalize minmax"},
+        {"colormap-stops", "--colormap stops:0:#000000,0.5:#00ff00,1:#ffffff"},
+        {"ppm", "--out {}/r.ppm"},
+        {"jpg", "--out {}/r.jpg"},
+        {"csv", "--csv {}/r.csv"},
+    };
+    double px = (double) size * size;
+    for (const auto& c : cs) {
+        std::string a = c.second;
+        for (size_t p; (p = a.find("{}")) != std::string::npos;) {
+            a.replace(p, 2, tmp);
+        }
+        std::string cmd = std::string("\"") + NOISE_CLI + "\" --width " + std::to_string(size) + " --height " + std::to_string(size) +
+                          " --threads " + std::to_string(threads) + " --out \"" + tmp + "/r.png\" " + a;
+        bs.push_back({std::string("render/") + c.first, px, [cmd]() {
+                          if (std::system(cmd.c_str()) != 0) {
+                              throw std::runtime_error("render failed: " + cmd);
+                          }
+                      }});
+    }
+}
+
+// The library renderer into caller memory: sampling and colormapping, no files.
+static void lib(std::vector<Bench>& bs, int size, int threads) {
+    const std::pair<const char*, const char*> cs[] = {
+        {"default", "None"},
+        {"fbm", "FBm"},
+    };
+    double px = (double) size * size;
+    auto f = std::make_shared<std::vector<float>>((size_t) size * (size_t) size);
+    auto rgb = std::make_shared<std::vector<uint8_t>>((size_t) size * (size_t) size * 3u);
+    for (const auto& c : cs) {
+        Cfg cfg;
+        cfg.w = cfg.h = size;
+        cfg.threads = threads;
+        cfg.fract = c.second;
+        auto r = std::make_shared<Renderer>(cfg);
+        bs.push_back({std::string("renderer/field/") + c.first, px, [r, f, size]() { r->field(0, 0, size, size, f->data(), (size_t) size); }});
+        bs.push_back({std::string("renderer/rgb/") + c.first, px,
+                      [r, rgb, size]() { r->rgb(0, 0, size, size, rgb->data(), (size_t) size * 3u); }});
+    }
+}
+
+static std::string line(const Res& r) {
+    char b[64];
+    std::snprintf(b, sizeof b, "%.3f,\"ms\":%.4f}", r.mpix, r.ms);
+    return "{\"name\":\"" + r.name + "\",\"mpix_s\":" + b;
+}
+
+static std::map<std::string, double> load(const std::string& path) {
+    std::map<std::string, double> m;
+    for (const std::string& s : split(read_all(path), '\n')) {
+        if (trim(s).empty()) {
+            continue;
+        }
+        Args a = Args::parse_json(s, Args());
+        float v;
+        if (!a.has("name") || !parse_f(a.get1("mpix_s", ""), v)) {
+            throw std::runtime_error("bad benchmark line in " + path + ": " + s);
+        }
+        m[a.get1("name", "")] = v;
+    }
+    return m;
+}
+
+// Prints the change of every benchmark in both runs; slower by more than `thr` percent is
+// a regression.
+static int compare(const std::map<std::string, double>& base, const std::vector<Res>& cur, double thr) {
+    int bad = 0;
+    for (const Res& r : cur) {
+        auto it = base.find(r.name);
+        if (it == base.end() || it->second <= 0.0) {
+            continue;
+        }
+        double d = (r.mpix / it->second - 1.0) * 100.0;
+        bool reg = d < -thr;
+        bad += reg;
+        std::printf("%-44s %10.2f -> %10.2f Mpix/s %+7.1f%%%s\n", r.name.c_str(), it->second, r.mpix, d, reg ? "  REGRESSION" : "");
+    }
+    std::printf("%d regression(s) beyond %.1f%%\n", bad, thr);
+    return bad ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    try {
+        Args a = Args::parse(argc, argv);
+        if (a.has("help") || a.has("h")) {
+            help();
+            return 0;
+        }
+        float min = 0.3f, thr = 10.0f;
+        int size = 1024, threads = 1;
+        if (a.has("min-time") && (!parse_f(a.get1("min-time", ""), min) || min < 0.0f)) {
+            throw std::runtime_error("bad --min-time");
+        }
+        if (a.has("threshold") && (!parse_f(a.get1("threshold", ""), thr) || thr < 0.0f)) {
+            throw std::runtime_error("bad --threshold");
+        }
+        if (a.has("size") && (!parse_i(a.get1("size", ""), size) || size < 1)) {
+            throw std::runtime_error("bad --size");
+        }
+        if (a.has("threads") && (!parse_i(a.get1("threads", ""), threads) || threads < 1)) {
+            throw std::runtime_error("bad --threads");
+        }
+        if (a.has("against")) {
+            if (!a.has("compare")) {
+                throw std::runtime_error("--against needs --compare");
+            }
+            std::vector<Res> cur;
+            for (const auto& e : load(a.get1("against", ""))) {
+                Res r;
+                r.name = e.first;
+                r.mpix = e.second;
+                cur.push_back(r);
+            }
+            return compare(load(a.get1("compare", "")), cur, thr);
+        }
+        std::string tmp = (std::filesystem::temp_directory_path() / "noise-bench").string();
+        std::filesystem::create_directories(tmp);
+        Grid g;
+        std::vector<Bench> bs;
+        micro(bs, g, tmp);
+        macro(bs, tmp, size, threads);
+        lib(bs, size, threads);
+        std::string flt = a.get1("filter", "");
+        std::vector<Res> rs;
+        std::printf("simd %s\n", isa_name(isa_best()));
+        for (const Bench& b : bs) {
+            if (b.name.find(flt) == std::string::npos) {
+                continue;
+            }
+            if (a.has("list")) {
+                std::printf("%s\n", b.name.c_str());
+                continue;
+            }
+            Res r = run(b, min);
+            std::printf("%-44s %10.2f Mpix/s %10.3f ms\n", r.name.c_str(), r.mpix, r.ms);
+            std::fflush(stdout);
+            rs.push_back(r);
+        }
+        if (a.has("json")) {
+            std::string s;
+            for (const Res& r : rs) {
+                s += line(r) + "\n";
+            }
+            write_all(a.get1("json", ""), s);
+        }
+        if (a.has("compare")) {
+            return compare(load(a.get1("compare", "")), rs, thr);
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "error: %s\n", e.what());
+        return 2;
+    }
+}
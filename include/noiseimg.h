@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Render settings. Fields and defaults mirror the command-line flags (see --help and the
+// README); strings are case-insensitive. cfg_from() derives warp_seed (seed + 1),
+// warp_freq (freq), warp_rot3 (rot3) and tile_p (w) when their flags are absent; a Cfg
+// built by hand should set them, though warp_freq <= 0, an empty warp_rot3 and
+// tile_p <= 0 fall back the same way.
+struct Cfg {
+    int w = 512;
+    int h = 512;
+    int seed = 0;
+    float freq = 0.01f;
+    float z = 0.0f;
+    int ox = 0, oy = 0;  // world pixel at the image's top-left corner
+    std::string type = "Perlin";
+    std::string rot3 = "None";
+    bool tile = false;
+    int tile_p = 0;
+    std::string tile_mode = "blend";
+    std::string fract = "None";
+    int oct = 5;
+    float gain = 0.5f;
+    float lac = 2.0f;
+    float wstr = 0.0f;
+    float pp = 2.0f;
+    std::string oct_cut = "off";
+    std::string cell_dist = "Euclidean";
+    std::string cell_ret = "Distance";
+    float cell_j = 1.0f;
+    bool warp = false;
+    std::string warp_type = "OpenSimplex2";
+    float warp_amp = 1.0f;
+    int warp_seed = 0;
+    float warp_freq = 0.0f;
+    std::string warp_rot3 = "";
+    std::string warp_fract = "None";
+    int warp_oct = 3;
+    float warp_gain = 0.5f;
+    float warp_lac = 2.0f;
+    std::string warp_engine = "legacy";
+    std::string norm = "fixed";
+    std::string cmap = "grayscale";
+    std::string out = "out.png";
+    std::string fmt = "";
+    std::string csv = "";
+    std::string raw = "";
+    std::string npy = "";
+    std::string dtype = "float32";
+    std::string field = "t";
+    int threads = 1;
+    std::string simd = "auto";
+    int multires = 0;
+    bool stats = false;
+    std::string stats_json = "";
+    std::string trace = "";
+    int shard_i = 0, shard_n = 0;  // file renders only: rows of shard i of shard_n (0: off)
+    bool shard_stats = false;
+    std::string cache = "";  // file renders only: heightfield cache directory
+    int cache_max = 2048;    // MiB
+    std::string pyramid = "";  // file renders only: z/x/y PNG tile directory instead of --out
+    int levels = 1;
+    int tile_size = 256;
+    std::string minmax_mode = "auto";
+    int png_level = 6;
+    std::string png_filter = "adaptive";
+    std::string png_color = "auto";
+    int jpeg_quality = 95;
+    std::string jpeg_sub = "auto";
+};
+
+struct RenderState;
+
+// Renders any rectangle of the image a Cfg describes into caller-owned memory, with no file
+// output and no encoding. The constructor validates the settings (std::runtime_error on a
+// bad one), bakes the colormap and, for every --normalize but fixed, samples the whole
+// image once for its range or histogram; it also applies --octave-cutoff and --multires.
+// After that, calls with Cfg::threads == 1 allocate nothing; more threads split the rows
+// of each call between par_for workers. A Renderer is not safe to use from two threads at
+// once; give each thread its own.
+class Renderer {
+public:
+    explicit Renderer(const Cfg& c);
+    ~Renderer();
+    Renderer(Renderer&&) noexcept;
+    Renderer& operator=(Renderer&&) noexcept;
+
+    int width() const;
+    int height() const;
+    // What --octave-cutoff and --multires decided, one line each (empty when off).
+    const std::string& report() const;
+
+    // Sampled noise values (the --field h heightfield) of the w x h rectangle at (x, y)
+    // into out, rows `stride` floats apart.
+    void field(int x, int y, int w, int h, float* out, size_t stride);
+    // The same rectangle normalized and colormapped: 3 bytes per pixel, rows `stride`
+    // bytes apart.
+    void rgb(int x, int y, int w, int h, uint8_t* out, size_t stride);
+
+private:
+    std::unique_ptr<RenderState> s;
+};
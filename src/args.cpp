@@ -1,5 +1,6 @@
 #include "args.h"
 #include "util.h"
+#include <cctype>
 #include <stdexcept>
 
 Args Args::parse(int argc, char** argv) {
@@ -32,6 +33,99 @@ Args Args::parse(int argc, char** argv) {
     return a;
 }
 
+Args Args::parse_json(const std::string& s, const Args& base) {
+    Args a = base;
+    size_t i = 0;
+    auto fail = [&]() { throw std::runtime_error("json parse error at " + std::to_string(i)); };
+    auto skip = [&]() {
+        while (i < s.size() && std::isspace((unsigned char) s[i])) {
+            i++;
+        }
+    };
+    auto eat = [&](char c) {
+        skip();
+        if (i >= s.size() || s[i] != c) {
+            fail();
+        }
+        i++;
+    };
+    auto str = [&]() -> std::string {
+        eat('"');
+        std::string r;
+        for (;;) {
+            if (i >= s.size()) {
+                fail();
+            }
+            char c = s[i++];
+            if (c == '"') {
+                return r;
+            }
+            if (c == '\\') {
+                if (i >= s.size()) {
+                    fail();
+                }
+                char d = s[i++];
+                if (d == 'n') {
+                    r += '\n';
+                } else if (d == 't') {
+                    r += '\t';
+                } else if (d == '"' || d == '\\' || d == '/') {
+                    r += d;
+                } else {
+                    throw std::runtime_error("json escape unsupported");
+                }
+            } else {
+                r += c;
+            }
+        }
+    };
+    eat('{');
+    skip();
+    if (i < s.size() && s[i] == '}') {
+        i++;
+    } else {
+        for (;;) {
+            std::string k = str();
+            eat(':');
+            skip();
+            if (i >= s.size()) {
+                fail();
+            }
+            if (s[i] == '"') {
+                a.m[k] = {str()};
+            } else {
+                size_t j = i;
+                while (j < s.size() && s[j] != ',' && s[j] != '}' && !std::isspace((unsigned char) s[j])) {
+                    j++;
+                }
+                std::string v = s.substr(i, j - i);
+                i = j;
+                if (v == "true") {
+                    a.m[k] = {};
+                } else if (v == "false" || v == "null") {
+                    a.m.erase(k);
+                } else if (!v.empty() && (std::isdigit((unsigned char) v[0]) || v[0] == '-' || v[0] == '.')) {
+                    a.m[k] = {v};
+                } else {
+                    fail();
+                }
+            }
+            skip();
+            if (i < s.size() && s[i] == ',') {
+                i++;
+                continue;
+            }
+            eat('}');
+            break;
+        }
+    }
+    skip();
+    if (i != s.size()) {
+        fail();
+    }
+    return a;
+}
+
 bool Args::has(const std::string& k) const {
     return m.find(k) != m.end();
 }
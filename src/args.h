@@ -6,6 +6,9 @@
 struct Args {
     std::unordered_map<std::string, std::vector<std::string>> m;
     static Args parse(int argc, char** argv);
+    // Applies one flat JSON object of flag -> value on top of `base`. true sets a bare flag,
+    // false and null remove the flag, strings and numbers become its value.
+    static Args parse_json(const std::string& s, const Args& base);
     bool has(const std::string& k) const;
     std::string get1(const std::string& k, const std::string& def) const;
 };
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "cache.h"
+#include "util.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+Field::~Field() {
+#if !defined(_WIN32)
+    if (base) {
+        ::munmap(base, len);
+    }
+#endif
+}
+
+std::string HfCache::hash(const std::string& key) {
+    uint64_t h = 1469598103934665603ull;
+    for (char ch : key) {
+        h = (h ^ (uint8_t) ch) * 1099511628211ull;
+    }
+    char b[20];
+    std::snprintf(b, sizeof b, "%016llx", (unsigned long long) h);
+    return b;
+}
+
+// "noise-hf 2", the key and "n min max ev", padded with spaces to a multiple of 64 bytes;
+// then n native-endian floats.
+static std::string header(const std::string& key, size_t n, float mn, float mx, float ev) {
+    char b[128];
+    std::snprintf(b, sizeof b, "%zu %.9g %.9g %.9g", n, mn, mx, ev);
+    std::string s = "noise-hf 2\n" + key + "\n" + b;
+    while (s.size() % 64 != 63) {
+        s += ' ';
+    }
+    return s + "\n";
+}
+
+bool HfCache::get(const std::string& key, size_t n, Field& f) const {
+    fs::path p = fs::path(dir) / (hash(key) + ".hf");
+    std::ifstream in(p, std::ios::binary);
+    std::string l0, l1, l2;
+    if (!in || !std::getline(in, l0) || !std::getline(in, l1) || !std::getline(in, l2) || l0 != "noise-hf 2" || l1 != key) {
+        return false;
+    }
+    std::vector<std::string> v = split(trim(l2), ' ');
+    float mn, mx, ev;
+    if (v.size() != 4 || v[0] != std::to_string(n) || !parse_f(v[1], mn) || !parse_f(v[2], mx) || !parse_f(v[3], ev)) {
+        return false;
+    }
+    size_t off = (size_t) in.tellg();
+    size_t len = off + n * sizeof(float);
+    std::error_code ec;
+    if (off % 64 != 0 || fs::file_size(p, ec) != len || ec) {
+        return false;
+    }
+#if defined(_WIN32)
+    f.own.resize(n);
+    if (!in.read((char*) f.own.data(), (std::streamsize) (n * sizeof(float)))) {
+        return false;
+    }
+    f.v = f.own.data();
+#else
+    in.close();
+    int fd = ::open(p.string().c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    void* m = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        return false;
+    }
+    f.base = m;
+    f.len = len;
+    f.v = (const float*) ((const char*) m + off);
+#endif
+    f.n = n;
+    f.mn = mn;
+    f.mx = mx;
+    f.ev = ev;
+    fs::last_write_time(p, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+void HfCache::put(const std::string& key, const float* v, size_t n, float mn, float mx, float ev) const {
+    std::string hd = header(key, n, mn, mx, ev);
+    uint64_t sz = hd.size() + (uint64_t) n * sizeof(float);
+    if (sz > cap) {
+        return;
+    }
+    fs::create_directories(dir);
+    std::string name = hash(key);
+    fs::path p = fs::path(dir) / (name + ".hf");
+    fs::path t = fs::path(dir) / (name + "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "." +
+                                  std::to_string((uintptr_t) &hd) + ".tmp");
+    {
+        std::ofstream o(t, std::ios::binary);
+        o.write(hd.data(), (std::streamsize) hd.size());
+        o.write((const char*) v, (std::streamsize) (n * sizeof(float)));
+        if (!o) {
+            o.close();
+            std::error_code ec;
+            fs::remove(t, ec);
+            throw std::runtime_error("failed to write cache entry " + t.string());
+        }
+    }
+    fs::rename(t, p);
+    // Least recently used first, until the entries fit.
+    struct Ent {
+        fs::path p;
+        fs::file_time_type t;
+        uint64_t sz;
+    };
+    std::vector<Ent> es;
+    uint64_t tot = 0;
+    std::error_code ec;
+    for (const fs::directory_entry& e : fs::directory_iterator(dir, ec)) {
+        if (e.path().extension() != ".hf") {
+            continue;
+        }
+        std::error_code e1, e2;
+        Ent x{e.path(), fs::last_write_time(e.path(), e1), (uint64_t) fs::file_size(e.path(), e2)};
+        if (!e1 && !e2) {
+            es.push_back(x);
+            tot += x.sz;
+        }
+    }
+    std::sort(es.begin(), es.end(), [](const Ent& a, const Ent& b) { return a.t < b.t; });
+    for (const Ent& e : es) {
+        if (tot <= cap) {
+            break;
+        }
+        if (e.p == p) {
+            continue;
+        }
+        std::error_code e1;
+        fs::remove(e.p, e1);
+        tot -= e.sz;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A cached heightfield, memory-mapped where the platform allows (read into `own` elsewhere).
+struct Field {
+    const float* v = nullptr;
+    size_t n = 0;
+    float mn = 0.0f, mx = 0.0f;
+    float ev = 0.0f;  // the --octave-cutoff budget the samples were cut to
+    void* base = nullptr;
+    size_t len = 0;
+    std::vector<float> own;
+
+    Field() = default;
+    Field(const Field&) = delete;
+    Field& operator=(const Field&) = delete;
+    ~Field();
+};
+
+// Heightfields on disk under `dir`, one file per noise key (named by its 64-bit FNV-1a
+// hash; the key itself is stored and checked). Every hit refreshes the entry's mtime, and
+// put() deletes the least recently used entries until the directory fits in `cap` bytes.
+// Entries are written to a temporary name and renamed, so concurrent renders can share one.
+struct HfCache {
+    std::string dir;
+    uint64_t cap = 0;
+
+    static std::string hash(const std::string& key);
+    // False on a miss (or an unreadable entry); f then stays empty.
+    bool get(const std::string& key, size_t n, Field& f) const;
+    void put(const std::string& key, const float* v, size_t n, float mn, float mx, float ev) const;
+};
@@ -1,6 +1,8 @@
 #include "colormap.h"
 #include "util.h"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <stdexcept>
 
 #define STB_IMAGE_STATIC
@@ -346,3 +348,150 @@ RGB Colormap::at(float t) const {
     float u = (b == a) ? 0.0f : (t - a) / (b - a);
     return lerp(s[lo].c, s[hi].c, u);
 }
+
+std::vector<uint32_t> Colormap::bake() const {
+    std::vector<uint32_t> l(lut_n);
+    for (int i = 0; i < lut_n; i++) {
+        RGB c = at((float) i / (float) (lut_n - 1));
+        l[i] = (uint32_t) c.r | ((uint32_t) c.g << 8) | ((uint32_t) c.b << 16);
+    }
+    return l;
+}
+
+Norm Norm::fixed() {
+    return Norm();
+}
+
+Norm Norm::minmax(float mn, float mx) {
+    Norm n;
+    n.s = mn;
+    n.o = 0.0f;
+    float d = mx - mn;
+    // A flat image has v == mn everywhere, so q = 1 maps it to 0.
+    n.q = d == 0.0f ? 1.0f : d;
+    return n;
+}
+
+float Norm::operator()(float v) const {
+    float t = clampv((v - s) / q + o, 0.0f, 1.0f);
+    if (eq) {
+        t = (*eq)[(size_t) (t * (float) (Colormap::lut_n - 1) + 0.5f)];
+    }
+    return t;
+}
+
+std::vector<uint32_t> Norm::bake(const std::vector<uint32_t>& lut) const {
+    if (!eq) {
+        return lut;
+    }
+    std::vector<uint32_t> l(lut.size());
+    for (size_t i = 0; i < l.size(); i++) {
+        l[i] = lut[(size_t) ((*eq)[i] * (float) (Colormap::lut_n - 1) + 0.5f)];
+    }
+    return l;
+}
+
+bool Palette::of(const uint32_t* lut, Palette& p) {
+    std::vector<uint32_t> ix((size_t) Colormap::lut_n);
+    bool gray = true;
+    for (int i = 0; i < Colormap::lut_n; i++) {
+        uint32_t c = lut[i];
+        uint32_t r = c & 0xffu;
+        gray = gray && ((c >> 8) & 0xffu) == r && ((c >> 16) & 0xffu) == r;
+        ix[(size_t) i] = r;
+    }
+    if (gray) {
+        p.pal.clear();
+        p.ix.swap(ix);
+        p.gray = true;
+        return true;
+    }
+    // Baked ramps are runs of equal colors, so checking against the last one found first
+    // skips most of the search.
+    std::vector<uint32_t> pal;
+    for (int i = 0; i < Colormap::lut_n; i++) {
+        uint32_t c = lut[i];
+        if (i > 0 && pal[ix[(size_t) i - 1]] == c) {
+            ix[(size_t) i] = ix[(size_t) i - 1];
+            continue;
+        }
+        size_t k = (size_t) (std::find(pal.begin(), pal.end(), c) - pal.begin());
+        if (k == pal.size()) {
+            if (pal.size() == 256) {
+                return false;
+            }
+            pal.push_back(c);
+        }
+        ix[(size_t) i] = (uint32_t) k;
+    }
+    p.pal.swap(pal);
+    p.ix.swap(ix);
+    p.gray = false;
+    return true;
+}
+
+static uint32_t fkey(float v) {
+    uint32_t u;
+    std::memcpy(&u, &v, 4);
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+static float fval(uint32_t k) {
+    uint32_t u = (k & 0x80000000u) ? (k & 0x7fffffffu) : ~k;
+    float v;
+    std::memcpy(&v, &u, 4);
+    return v;
+}
+
+void Hist::clear() {
+    n.assign((size_t) 1 << bits, 0u);
+    cum.clear();
+}
+
+void Hist::add(const float* v, int cnt) {
+    for (int i = 0; i < cnt; i++) {
+        n[fkey(v[i]) >> (32 - bits)]++;
+    }
+}
+
+void Hist::merge(const Hist& h) {
+    for (size_t i = 0; i < n.size(); i++) {
+        n[i] += h.n[i];
+    }
+}
+
+void Hist::done() {
+    cum.resize(n.size() + 1);
+    cum[0] = 0;
+    for (size_t i = 0; i < n.size(); i++) {
+        cum[i + 1] = cum[i] + n[i];
+    }
+}
+
+float Hist::quantile(double q) const {
+    uint64_t tot = cum.back();
+    if (tot == 0) {
+        return 0.0f;
+    }
+    double want = clampv(q, 0.0, 1.0) * (double) tot;
+    size_t b = (size_t) (std::upper_bound(cum.begin(), cum.end(), (uint64_t) want) - cum.begin()) - 1;
+    b = std::min(b, n.size() - 1);
+    while (n[b] == 0 && b > 0) {
+        b--;
+    }
+    double f = n[b] ? clampv((want - (double) cum[b]) / (double) n[b], 0.0, 1.0) : 0.0;
+    // Keys are linear in the value within a bin (one exponent, consecutive mantissas).
+    uint64_t k = ((uint64_t) b << (32 - bits)) + (uint64_t) (f * (double) ((uint64_t) 1 << (32 - bits)));
+    return fval((uint32_t) std::min<uint64_t>(k, 0xffffffffu));
+}
+
+float Hist::cdf(float v) const {
+    uint64_t tot = cum.back();
+    if (tot == 0) {
+        return 0.0f;
+    }
+    uint32_t k = fkey(v);
+    size_t b = k >> (32 - bits);
+    double f = (double) (k & ((1u << (32 - bits)) - 1u)) / (double) (1u << (32 - bits));
+    return (float) (((double) cum[b] + f * (double) n[b]) / (double) tot);
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -15,9 +16,54 @@ struct Stop {
 };
 
 struct Colormap {
+    static const int lut_n = 65536;
     bool ramp = false;
     std::vector<Stop> s;
     std::vector<RGB> r;
     static Colormap parse(const std::string& spec);
     RGB at(float t) const;
+    std::vector<uint32_t> bake() const;
+};
+
+// Maps a sampled value to t in [0,1] as clamp((v - s) / q + o). With `eq`, that t then
+// indexes a lut_n table of equalized t (colorize() only applies the linear part; bake the
+// table into the colormap with Norm::bake).
+struct Norm {
+    float s = 0.0f;
+    float q = 2.0f;
+    float o = 0.5f;
+    std::shared_ptr<const std::vector<float>> eq;
+    static Norm fixed();
+    static Norm minmax(float mn, float mx);
+    float operator()(float v) const;
+    std::vector<uint32_t> bake(const std::vector<uint32_t>& lut) const;
+};
+
+// The colors of a baked lut when there are at most 256 of them, for palette images. ix maps
+// each lut entry to a palette index, so it can stand in for the lut in colorize_index().
+// When every color is gray, `gray` is set, pal is empty and the index is the gray level.
+struct Palette {
+    std::vector<uint32_t> pal, ix;
+    bool gray = false;
+    // False (and p untouched) when the lut has more than 256 colors.
+    static bool of(const uint32_t* lut, Palette& p);
+};
+
+// Counts of sampled values by the top `bits` bits of their order-preserving float key
+// (sign, exponent and 9 mantissa bits), so a bin spans about 0.2% of the value at any
+// magnitude and no range has to be known up front. Each thread fills its own; the render
+// merges them.
+struct Hist {
+    static const int bits = 18;
+    std::vector<uint64_t> n;    // 64-bit so that merged workers and shards cannot wrap a bin
+    std::vector<uint64_t> cum;  // cum[b]: values in bins below b, after done()
+
+    void clear();
+    void add(const float* v, int cnt);
+    void merge(const Hist& h);
+    void done();
+    // Value below which a fraction q of the samples lie, interpolated within its bin.
+    float quantile(double q) const;
+    // Fraction of the samples below v.
+    float cdf(float v) const;
 };
@@ -0,0 +1,444 @@
+#include "deflate.h"
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <utility>
+
+namespace {
+
+const size_t win = 32768;
+const int hbits = 15;
+const size_t block_toks = 16384;
+
+const uint16_t len_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+const uint8_t cl_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// Per level, as in zlib: chain depth, stop at a match this long, look for a longer match at
+// the next byte only below `lazy`, and search a quarter of the chain once a match is `good`.
+struct Lvl {
+    int chain, nice, lazy, good;
+};
+const Lvl lvl_of[10] = {{0, 0, 0, 0}, {4, 8, 0, 4}, {8, 16, 0, 4}, {32, 32, 0, 4}, {16, 16, 4, 4}, {32, 32, 16, 8}, {128, 128, 16, 8}, {256, 128, 32, 8}, {512, 258, 128, 32}, {1024, 258, 258, 32}};
+
+struct Bits {
+    std::vector<uint8_t>& o;
+    uint64_t acc = 0;
+    int n = 0;
+
+    explicit Bits(std::vector<uint8_t>& o0) : o(o0) {}
+
+    void put(uint32_t v, int k) {
+        acc |= (uint64_t) v << n;
+        n += k;
+        while (n >= 8) {
+            o.push_back((uint8_t) acc);
+            acc >>= 8;
+            n -= 8;
+        }
+    }
+
+    void align() {
+        if (n > 0) {
+            put(0, 8 - n);
+        }
+    }
+};
+
+// d == 0: literal a; otherwise a match of length a at distance d.
+struct Tok {
+    uint16_t a, d;
+};
+
+int len_code(int l) {
+    return (int) (std::upper_bound(len_base, len_base + 29, (uint16_t) l) - len_base) - 1;
+}
+
+int dist_code(int d) {
+    return (int) (std::upper_bound(dist_base, dist_base + 30, (uint16_t) d) - dist_base) - 1;
+}
+
+// At least two used symbols keep every tree complete, which some decoders insist on.
+void min2(uint32_t* f, int n) {
+    int used = 0;
+    for (int i = 0; i < n; i++) {
+        used += f[i] != 0;
+    }
+    for (int i = 0; i < n && used < 2; i++) {
+        if (!f[i]) {
+            f[i] = 1;
+            used++;
+        }
+    }
+}
+
+// Huffman code lengths of at most `lim` bits; frequencies are flattened until the tree fits.
+void lengths(const uint32_t* fr, int n, int lim, uint8_t* len) {
+    std::vector<uint64_t> f(fr, fr + n);
+    for (;;) {
+        std::fill(len, len + n, (uint8_t) 0);
+        typedef std::pair<uint64_t, int> Node;
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> q;
+        std::vector<int> par;
+        std::vector<int> sym;
+        for (int i = 0; i < n; i++) {
+            if (f[i]) {
+                q.push(Node(f[i], (int) sym.size()));
+                sym.push_back(i);
+                par.push_back(-1);
+            }
+        }
+        int m = (int) sym.size();
+        while (q.size() > 1) {
+            Node a = q.top();
+            q.pop();
+            Node b = q.top();
+            q.pop();
+            int id = (int) par.size();
+            par.push_back(-1);
+            par[a.second] = id;
+            par[b.second] = id;
+            q.push(Node(a.first + b.first, id));
+        }
+        std::vector<int> dep(par.size(), 0);
+        int mx = 0;
+        for (int i = (int) par.size() - 2; i >= 0; i--) {
+            dep[i] = dep[par[i]] + 1;
+            if (i < m) {
+                mx = std::max(mx, dep[i]);
+            }
+        }
+        if (mx <= lim) {
+            for (int i = 0; i < m; i++) {
+                len[sym[i]] = (uint8_t) dep[i];
+            }
+            return;
+        }
+        for (uint64_t& v : f) {
+            if (v) {
+                v = (v >> 1) | 1;
+            }
+        }
+    }
+}
+
+void codes(const uint8_t* len, int n, uint16_t* code) {
+    int cnt[16] = {0};
+    for (int i = 0; i < n; i++) {
+        cnt[len[i]]++;
+    }
+    cnt[0] = 0;
+    int next[16] = {0};
+    int c = 0;
+    for (int b = 1; b < 16; b++) {
+        c = (c + cnt[b - 1]) << 1;
+        next[b] = c;
+    }
+    for (int i = 0; i < n; i++) {
+        if (len[i]) {
+            int v = next[len[i]]++;
+            int r = 0;
+            for (int k = 0; k < len[i]; k++) {
+                r = (r << 1) | ((v >> k) & 1);
+            }
+            code[i] = (uint16_t) r;
+        }
+    }
+}
+
+void block(Bits& b, const Tok* t, size_t n) {
+    uint32_t lf[286] = {0}, df[30] = {0};
+    for (size_t i = 0; i < n; i++) {
+        if (t[i].d == 0) {
+            lf[t[i].a]++;
+        } else {
+            lf[257 + len_code(t[i].a)]++;
+            df[dist_code(t[i].d)]++;
+        }
+    }
+    lf[256] = 1;
+    min2(lf, 286);
+    min2(df, 30);
+    uint8_t ll[286], dl[30];
+    uint16_t lc[286] = {0}, dc[30] = {0};
+    lengths(lf, 286, 15, ll);
+    lengths(df, 30, 15, dl);
+    codes(ll, 286, lc);
+    codes(dl, 30, dc);
+    int hlit = 286;
+    while (hlit > 257 && ll[hlit - 1] == 0) {
+        hlit--;
+    }
+    int hdist = 30;
+    while (hdist > 1 && dl[hdist - 1] == 0) {
+        hdist--;
+    }
+    std::vector<uint8_t> all(ll, ll + hlit);
+    all.insert(all.end(), dl, dl + hdist);
+    std::vector<std::pair<uint8_t, uint8_t>> rl;
+    for (size_t i = 0; i < all.size();) {
+        uint8_t v = all[i];
+        size_t run = 1;
+        while (i + run < all.size() && all[i + run] == v) {
+            run++;
+        }
+        i += run;
+        if (v == 0) {
+            while (run >= 11) {
+                size_t k = std::min(run, (size_t) 138);
+                rl.push_back(std::make_pair((uint8_t) 18, (uint8_t) (k - 11)));
+                run -= k;
+            }
+            if (run >= 3) {
+                rl.push_back(std::make_pair((uint8_t) 17, (uint8_t) (run - 3)));
+                run = 0;
+            }
+        } else {
+            rl.push_back(std::make_pair(v, (uint8_t) 0));
+            run--;
+            while (run >= 3) {
+                size_t k = std::min(run, (size_t) 6);
+                rl.push_back(std::make_pair((uint8_t) 16, (uint8_t) (k - 3)));
+                run -= k;
+            }
+        }
+        for (; run > 0; run--) {
+            rl.push_back(std::make_pair(v, (uint8_t) 0));
+        }
+    }
+    uint32_t cf[19] = {0};
+    for (const auto& r : rl) {
+        cf[r.first]++;
+    }
+    min2(cf, 19);
+    uint8_t cl[19];
+    uint16_t cc[19] = {0};
+    lengths(cf, 19, 7, cl);
+    codes(cl, 19, cc);
+    int hclen = 19;
+    while (hclen > 4 && cl[cl_order[hclen - 1]] == 0) {
+        hclen--;
+    }
+    b.put(0, 1);
+    b.put(2, 2);
+    b.put((uint32_t) (hlit - 257), 5);
+    b.put((uint32_t) (hdist - 1), 5);
+    b.put((uint32_t) (hclen - 4), 4);
+    for (int i = 0; i < hclen; i++) {
+        b.put(cl[cl_order[i]], 3);
+    }
+    for (const auto& r : rl) {
+        b.put(cc[r.first], cl[r.first]);
+        if (r.first == 16) {
+            b.put(r.second, 2);
+        } else if (r.first == 17) {
+            b.put(r.second, 3);
+        } else if (r.first == 18) {
+            b.put(r.second, 7);
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (t[i].d == 0) {
+            b.put(lc[t[i].a], ll[t[i].a]);
+        } else {
+            int c = len_code(t[i].a);
+            b.put(lc[257 + c], ll[257 + c]);
+            b.put((uint32_t) (t[i].a - len_base[c]), len_extra[c]);
+            int e = dist_code(t[i].d);
+            b.put(dc[e], dl[e]);
+            b.put((uint32_t) (t[i].d - dist_base[e]), dist_extra[e]);
+        }
+    }
+    b.put(lc[256], ll[256]);
+}
+
+void stored(Bits& b, const uint8_t* p, size_t n) {
+    while (n > 0) {
+        size_t k = std::min(n, (size_t) 65535);
+        b.put(0, 3);
+        b.align();
+        b.put((uint32_t) k, 16);
+        b.put((uint32_t) (~k & 0xffff), 16);
+        b.o.insert(b.o.end(), p, p + k);
+        p += k;
+        n -= k;
+    }
+}
+
+struct Lz {
+    const uint8_t* base;
+    size_t end;
+    Lvl lv;
+    std::vector<int32_t> head, prev;
+
+    Lz(const uint8_t* b, size_t e, int level) : base(b), end(e), lv(lvl_of[level]), head((size_t) 1 << hbits, -1), prev(win, -1) {}
+
+    uint32_t hash(size_t p) const {
+        uint32_t v = (uint32_t) base[p] << 16 | (uint32_t) base[p + 1] << 8 | base[p + 2];
+        return (v * 2654435761u) >> (32 - hbits);
+    }
+
+    void ins(size_t p) {
+        if (p + 3 <= end) {
+            uint32_t h = hash(p);
+            prev[p & (win - 1)] = head[h];
+            head[h] = (int32_t) p;
+        }
+    }
+
+    // Longest match at p among earlier positions that beats `best`; returns its length
+    // (0 if none) and sets `dist`.
+    int find(size_t p, int best, int& dist) const {
+        if (p + 3 > end) {
+            return 0;
+        }
+        int lim = (int) std::min((size_t) 258, end - p);
+        if (best >= lim) {
+            return 0;
+        }
+        int found = 0;
+        int chain = best >= lv.good ? lv.chain >> 2 : lv.chain;
+        best = std::max(best, 2);
+        int32_t c = head[hash(p)];
+        for (int k = chain; c >= 0 && k > 0; k--) {
+            if (p - (size_t) c > win) {
+                break;
+            }
+            const uint8_t* a = base + c;
+            const uint8_t* q = base + p;
+            if (a[best] == q[best] && a[best - 1] == q[best - 1] && a[0] == q[0]) {
+                int l = 0;
+                while (l < lim && a[l] == q[l]) {
+                    l++;
+                }
+                if (l > best) {
+                    best = found = l;
+                    dist = (int) (p - (size_t) c);
+                    if (l >= lim || l >= lv.nice) {
+                        break;
+                    }
+                }
+            }
+            c = prev[(size_t) c & (win - 1)];
+        }
+        return found;
+    }
+};
+
+}
+
+void deflate_chunk(const uint8_t* base, size_t dn, size_t n, int level, std::vector<uint8_t>& out) {
+    Bits b(out);
+    if (level <= 0) {
+        stored(b, base + dn, n);
+        return;
+    }
+    level = std::min(level, 9);
+    if (dn > win) {
+        base += dn - win;
+        dn = win;
+    }
+    Lz z(base, dn + n, level);
+    for (size_t p = 0; p < dn; p++) {
+        z.ins(p);
+    }
+    std::vector<Tok> t;
+    t.reserve(std::min(n, block_toks));
+    size_t p = dn;
+    int l = 0, d = 0;
+    bool have = false;
+    while (p < dn + n) {
+        if (!have) {
+            l = z.find(p, 0, d);
+        }
+        have = false;
+        if (l && l < z.lv.lazy) {
+            int d2 = 0;
+            int l2 = z.find(p + 1, l, d2);
+            if (l2) {
+                t.push_back(Tok{base[p], 0});
+                z.ins(p);
+                p++;
+                l = l2;
+                d = d2;
+                have = true;
+                if (t.size() == block_toks) {
+                    block(b, t.data(), t.size());
+                    t.clear();
+                }
+                continue;
+            }
+        }
+        if (l) {
+            t.push_back(Tok{(uint16_t) l, (uint16_t) d});
+            for (int k = 0; k < l; k++) {
+                z.ins(p + (size_t) k);
+            }
+            p += (size_t) l;
+        } else {
+            t.push_back(Tok{base[p], 0});
+            z.ins(p);
+            p++;
+        }
+        if (t.size() == block_toks) {
+            block(b, t.data(), t.size());
+            t.clear();
+        }
+    }
+    if (!t.empty()) {
+        block(b, t.data(), t.size());
+    }
+    b.put(0, 3);
+    b.align();
+    b.put(0, 16);
+    b.put(0xffff, 16);
+}
+
+uint32_t adler32(uint32_t a, const uint8_t* p, size_t n) {
+    uint32_t s1 = a & 0xffff, s2 = a >> 16;
+    while (n > 0) {
+        size_t k = std::min(n, (size_t) 5552);
+        n -= k;
+        for (size_t i = 0; i < k; i++) {
+            s1 += p[i];
+            s2 += s1;
+        }
+        p += k;
+        s1 %= 65521;
+        s2 %= 65521;
+    }
+    return s1 | (s2 << 16);
+}
+
+uint32_t adler32_combine(uint32_t a1, uint32_t a2, size_t n2) {
+    const uint32_t m = 65521;
+    uint32_t r = (uint32_t) (n2 % m);
+    uint32_t s1 = a1 & 0xffff;
+    uint32_t s2 = (uint32_t) (((uint64_t) r * s1) % m);
+    s1 += (a2 & 0xffff) + m - 1;
+    s2 += (a1 >> 16) + (a2 >> 16) + m - r;
+    s1 %= m;
+    s2 %= m;
+    return s1 | (s2 << 16);
+}
+
+uint32_t crc32(uint32_t c, const uint8_t* p, size_t n) {
+    static const std::vector<uint32_t> tab = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t v = i;
+            for (int k = 0; k < 8; k++) {
+                v = (v & 1) ? 0xedb88320u ^ (v >> 1) : v >> 1;
+            }
+            t[i] = v;
+        }
+        return t;
+    }();
+    c = ~c;
+    for (size_t i = 0; i < n; i++) {
+        c = tab[(c ^ p[i]) & 0xff] ^ (c >> 8);
+    }
+    return ~c;
+}
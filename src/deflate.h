@@ -0,0 +1,13 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Appends raw deflate blocks for base[dn, dn + n) to `out`. Matches may reach back into the
+// dn bytes before it (at most 32 KiB are used). The output ends byte-aligned on a sync flush
+// and is never final, so chunks compressed independently can be concatenated into one stream.
+void deflate_chunk(const uint8_t* base, size_t dn, size_t n, int level, std::vector<uint8_t>& out);
+
+uint32_t adler32(uint32_t a, const uint8_t* p, size_t n);
+uint32_t adler32_combine(uint32_t a1, uint32_t a2, size_t n2);
+uint32_t crc32(uint32_t c, const uint8_t* p, size_t n);
@@ -0,0 +1,317 @@
+#include "jpeg.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+
+const uint8_t zz[64] = {0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+                        41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+                        30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+// Annex K.1 quantizers, natural order.
+const uint8_t qt_y[64] = {16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,  14, 13, 16, 24,  40,  57,
+                          69, 56, 14, 17, 22,  29,  51,  87,  80, 62, 18, 22, 37,  56,  68,  109, 103, 77, 24, 35, 55, 64,
+                          81, 104, 113, 92, 49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99};
+const uint8_t qt_c[64] = {17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99,
+                          99, 99, 47, 66, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+                          99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+
+// Annex K.3 Huffman tables: code counts by length 1..16, then the symbols.
+const uint8_t dc_y_n[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+const uint8_t dc_c_n[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+const uint8_t dc_v[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+const uint8_t ac_y_n[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+const uint8_t ac_y_v[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81,
+    0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18,
+    0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75,
+    0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+    0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5,
+    0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+const uint8_t ac_c_n[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+const uint8_t ac_c_v[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08,
+    0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25,
+    0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47,
+    0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74,
+    0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+    0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba,
+    0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4,
+    0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+// AAN scale factors: the float DCT below leaves output (u, v) multiplied by 8 * a[u] * a[v].
+const float aan[8] = {1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f};
+
+// Canonical codes by symbol.
+struct Huff {
+    uint16_t code[256] = {0};
+    uint8_t len[256] = {0};
+
+    Huff(const uint8_t* n, const uint8_t* v) {
+        int k = 0;
+        uint16_t c = 0;
+        for (int l = 1; l <= 16; l++) {
+            for (int i = 0; i < n[l - 1]; i++) {
+                code[v[k]] = c++;
+                len[v[k]] = (uint8_t) l;
+                k++;
+            }
+            c = (uint16_t) (c << 1);
+        }
+    }
+};
+
+const Huff& huff(int t) {
+    static const Huff hs[4] = {Huff(dc_y_n, dc_v), Huff(ac_y_n, ac_y_v), Huff(dc_c_n, dc_v), Huff(ac_c_n, ac_c_v)};
+    return hs[t];
+}
+
+// Most significant bit first, with a 0 stuffed after every 0xFF byte.
+struct Bits {
+    std::vector<uint8_t>& o;
+    uint32_t acc = 0;
+    int n = 0;
+
+    explicit Bits(std::vector<uint8_t>& o0) : o(o0) {}
+
+    void put(uint32_t v, int k) {
+        acc = (acc << k) | (v & ((1u << k) - 1u));
+        n += k;
+        while (n >= 8) {
+            uint8_t b = (uint8_t) (acc >> (n - 8));
+            o.push_back(b);
+            if (b == 0xFF) {
+                o.push_back(0);
+            }
+            n -= 8;
+        }
+        acc &= (1u << n) - 1u;
+    }
+
+    // Pads the last byte with 1 bits.
+    void align() {
+        if (n > 0) {
+            put(0xFF, 8 - n);
+        }
+    }
+};
+
+int nbits(int v) {
+    int a = std::abs(v), k = 0;
+    while (a) {
+        k++;
+        a >>= 1;
+    }
+    return k;
+}
+
+// In-place AAN forward DCT of one stride-s line of 8 (as in libjpeg's jfdctflt.c).
+inline void dct8(float* d, int s) {
+    float t0 = d[0] + d[7 * s], t7 = d[0] - d[7 * s];
+    float t1 = d[s] + d[6 * s], t6 = d[s] - d[6 * s];
+    float t2 = d[2 * s] + d[5 * s], t5 = d[2 * s] - d[5 * s];
+    float t3 = d[3 * s] + d[4 * s], t4 = d[3 * s] - d[4 * s];
+    float t10 = t0 + t3, t13 = t0 - t3, t11 = t1 + t2, t12 = t1 - t2;
+    d[0] = t10 + t11;
+    d[4 * s] = t10 - t11;
+    float z1 = (t12 + t13) * 0.707106781f;
+    d[2 * s] = t13 + z1;
+    d[6 * s] = t13 - z1;
+    t10 = t4 + t5;
+    t11 = t5 + t6;
+    t12 = t6 + t7;
+    float z5 = (t10 - t12) * 0.382683433f;
+    float z2 = 0.541196100f * t10 + z5;
+    float z4 = 1.306562965f * t12 + z5;
+    float z3 = t11 * 0.707106781f;
+    float z11 = t7 + z3, z13 = t7 - z3;
+    d[5 * s] = z13 + z2;
+    d[3 * s] = z13 - z2;
+    d[s] = z11 + z4;
+    d[7 * s] = z11 - z4;
+}
+
+// DCT, quantization and Huffman coding of one level-shifted block; returns its DC for the
+// next block's prediction.
+int block(Bits& b, float* d, const float* fq, int dc, const Huff& hd, const Huff& ha) {
+    for (int i = 0; i < 8; i++) {
+        dct8(d + i * 8, 1);
+    }
+    for (int i = 0; i < 8; i++) {
+        dct8(d + i, 8);
+    }
+    int z[64];
+    for (int k = 0; k < 64; k++) {
+        float v = d[zz[k]] * fq[zz[k]];
+        z[k] = (int) (v < 0.0f ? v - 0.5f : v + 0.5f);
+    }
+    int diff = z[0] - dc;
+    int c = nbits(diff);
+    b.put(hd.code[c], hd.len[c]);
+    if (c) {
+        b.put((uint32_t) (diff < 0 ? diff - 1 : diff), c);
+    }
+    int end = 63;
+    while (end > 0 && z[end] == 0) {
+        end--;
+    }
+    int run = 0;
+    for (int k = 1; k <= end; k++) {
+        if (z[k] == 0) {
+            run++;
+            continue;
+        }
+        for (; run >= 16; run -= 16) {
+            b.put(ha.code[0xF0], ha.len[0xF0]);
+        }
+        c = nbits(z[k]);
+        int sym = (run << 4) | c;
+        b.put(ha.code[sym], ha.len[sym]);
+        b.put((uint32_t) (z[k] < 0 ? z[k] - 1 : z[k]), c);
+        run = 0;
+    }
+    if (end < 63) {
+        b.put(ha.code[0x00], ha.len[0x00]);
+    }
+    return z[0];
+}
+
+void be16(std::string& s, int v) {
+    s += (char) (v >> 8);
+    s += (char) v;
+}
+
+void marker(std::string& s, int m, int len) {
+    s += (char) 0xFF;
+    s += (char) m;
+    be16(s, len);
+}
+
+}
+
+Jpeg::Jpeg(int w0, int h0, int quality, const std::string& sub) : w(w0), h(h0) {
+    if (w < 1 || h < 1 || w > 65535 || h > 65535) {
+        throw std::runtime_error("jpeg images are at most 65535 pixels on a side");
+    }
+    if (quality < 1 || quality > 100) {
+        throw std::runtime_error("bad jpeg quality: " + std::to_string(quality));
+    }
+    if (sub == "444") {
+        hs = vs = 1;
+    } else if (sub == "422") {
+        hs = 2;
+        vs = 1;
+    } else if (sub == "420") {
+        hs = vs = 2;
+    } else {
+        throw std::runtime_error("bad jpeg subsampling: " + sub);
+    }
+    int sc = quality < 50 ? 5000 / quality : 200 - 2 * quality;
+    for (int t = 0; t < 2; t++) {
+        const uint8_t* base = t == 0 ? qt_y : qt_c;
+        for (int k = 0; k < 64; k++) {
+            int n = zz[k];
+            int v = std::min(255, std::max(1, (base[n] * sc + 50) / 100));
+            q[t][k] = (uint8_t) v;
+            fq[t][n] = 1.0f / ((float) v * aan[n / 8] * aan[n % 8] * 8.0f);
+        }
+    }
+}
+
+std::string Jpeg::header(int ri) const {
+    std::string s;
+    s += "\xFF\xD8";
+    marker(s, 0xE0, 16);
+    s.append("JFIF\0\x01\x01\x00\x00\x01\x00\x01\x00\x00", 14);
+    marker(s, 0xDB, 2 + 2 * 65);
+    for (int t = 0; t < 2; t++) {
+        s += (char) t;
+        s.append((const char*) q[t], 64);
+    }
+    marker(s, 0xC0, 17);
+    s += (char) 8;
+    be16(s, h);
+    be16(s, w);
+    s += (char) 3;
+    const char comp[9] = {1, (char) ((hs << 4) | vs), 0, 2, 0x11, 1, 3, 0x11, 1};
+    s.append(comp, 9);
+    marker(s, 0xC4, 2 + 4 * 17 + 2 * 12 + 2 * 162);
+    const uint8_t* tn[4] = {dc_y_n, ac_y_n, dc_c_n, ac_c_n};
+    const uint8_t* tv[4] = {dc_v, ac_y_v, dc_v, ac_c_v};
+    const int tc[4] = {0x00, 0x10, 0x01, 0x11};
+    for (int t = 0; t < 4; t++) {
+        s += (char) tc[t];
+        s.append((const char*) tn[t], 16);
+        s.append((const char*) tv[t], t % 2 == 0 ? 12 : 162);
+    }
+    marker(s, 0xDD, 4);
+    be16(s, ri);
+    marker(s, 0xDA, 12);
+    const char sos[10] = {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+    s.append(sos, 10);
+    return s;
+}
+
+void Jpeg::strip(const uint8_t* rgb, int rows, std::vector<uint8_t>& out) const {
+    // Planes padded to whole MCUs by repeating the last column and row, then chroma averaged
+    // down to its sampling.
+    int mw = mcu_w(), mh = mcu_h();
+    int pw = mcus() * mw, ph = (rows + mh - 1) / mh * mh;
+    std::vector<float> yp((size_t) pw * ph), cb((size_t) pw * ph), cr((size_t) pw * ph);
+    for (int y = 0; y < ph; y++) {
+        const uint8_t* r = rgb + (size_t) std::min(y, rows - 1) * (size_t) w * 3u;
+        size_t o = (size_t) y * pw;
+        for (int x = 0; x < pw; x++) {
+            const uint8_t* p = r + (size_t) std::min(x, w - 1) * 3u;
+            float R = p[0], G = p[1], B = p[2];
+            yp[o + x] = 0.299f * R + 0.587f * G + 0.114f * B - 128.0f;
+            cb[o + x] = -0.168736f * R - 0.331264f * G + 0.5f * B;
+            cr[o + x] = 0.5f * R - 0.418688f * G - 0.081312f * B;
+        }
+    }
+    int cw = pw / hs, chh = ph / vs;
+    if (hs > 1 || vs > 1) {
+        float k = 1.0f / (float) (hs * vs);
+        for (int y = 0; y < chh; y++) {
+            for (int x = 0; x < cw; x++) {
+                float a = 0.0f, b = 0.0f;
+                for (int j = 0; j < vs; j++) {
+                    for (int i = 0; i < hs; i++) {
+                        size_t o = (size_t) (y * vs + j) * pw + (size_t) (x * hs + i);
+                        a += cb[o];
+                        b += cr[o];
+                    }
+                }
+                cb[(size_t) y * cw + x] = a * k;
+                cr[(size_t) y * cw + x] = b * k;
+            }
+        }
+    }
+    const Huff &dy = huff(0), &ay = huff(1), &dc = huff(2), &ac = huff(3);
+    Bits bt(out);
+    int pred[3] = {0, 0, 0};
+    float d[64];
+    auto load = [&](const std::vector<float>& p, int stride, int x0, int y0) {
+        for (int j = 0; j < 8; j++) {
+            std::copy_n(p.data() + (size_t) (y0 + j) * stride + x0, 8, d + j * 8);
+        }
+    };
+    for (int my = 0; my < ph / mh; my++) {
+        for (int mx = 0; mx < mcus(); mx++) {
+            for (int j = 0; j < vs; j++) {
+                for (int i = 0; i < hs; i++) {
+                    load(yp, pw, mx * mw + i * 8, my * mh + j * 8);
+                    pred[0] = block(bt, d, fq[0], pred[0], dy, ay);
+                }
+            }
+            load(cb, cw, mx * 8, my * 8);
+            pred[1] = block(bt, d, fq[1], pred[1], dc, ac);
+            load(cr, cw, mx * 8, my * 8);
+            pred[2] = block(bt, d, fq[1], pred[2], dc, ac);
+        }
+    }
+    bt.align();
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Baseline JFIF encoder with the Annex K Huffman tables. The image is cut into strips of
+// whole MCU rows, each one restart interval: strips are entropy-coded on their own (on any
+// thread) and joined with RSTn markers between them.
+struct Jpeg {
+    int w = 0, h = 0;
+    int hs = 1, vs = 1;  // luma samples per chroma sample across and down
+    uint8_t q[2][64];    // luma and chroma quantizers, zigzag order
+    float fq[2][64];     // their reciprocals with the DCT's scaling folded in, natural order
+
+    // sub: 444, 422 or 420; quality 1..100 scales the Annex K tables as libjpeg does.
+    Jpeg(int w, int h, int quality, const std::string& sub);
+    int mcu_w() const { return 8 * hs; }
+    int mcu_h() const { return 8 * vs; }
+    int mcus() const { return (w + mcu_w() - 1) / mcu_w(); }
+    // SOI up to and including SOS, for restart intervals of `ri` MCUs.
+    std::string header(int ri) const;
+    // Entropy-coded data for `rows` RGB rows of w pixels: whole MCU rows, except that the last
+    // strip of the image may end early (its bottom row is repeated). Byte-aligned, with 0xFF
+    // stuffed, and no marker.
+    void strip(const uint8_t* rgb, int rows, std::vector<uint8_t>& out) const;
+};
@@ -0,0 +1,565 @@
+#include "out.h"
+#include "deflate.h"
+#include "jpeg.h"
+#include "par.h"
+#include "util.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// A file written front to back, or (shared) at explicit offsets into one that other
+// processes write too: created if missing, never truncated below `size`, written with
+// pwrite so the writers share no file position.
+struct File {
+    std::string path;
+    bool shared = false;
+    std::ofstream f;
+    std::fstream g;  // shared, where there is no pwrite
+    int fd = -1;
+    uint64_t at = 0;
+    bool bad = false;
+
+    File(const std::string& p, bool sh, uint64_t size) : path(p), shared(sh) {
+        if (!shared) {
+            f.open(p, std::ios::binary);
+            bad = !f;
+            return;
+        }
+#if defined(_WIN32)
+        (void) size;
+        std::ofstream(p, std::ios::binary | std::ios::app).close();
+        g.open(p, std::ios::binary | std::ios::in | std::ios::out);
+        bad = !g;
+#else
+        fd = ::open(p.c_str(), O_WRONLY | O_CREAT, 0644);
+        bad = fd < 0 || ::ftruncate(fd, (off_t) size) != 0;
+#endif
+    }
+
+    ~File() {
+#if !defined(_WIN32)
+        if (fd >= 0) {
+            ::close(fd);
+        }
+#endif
+    }
+
+    void write(const void* p, size_t n) {
+        if (!shared) {
+            f.write((const char*) p, (std::streamsize) n);
+            return;
+        }
+#if defined(_WIN32)
+        g.seekp((std::streamoff) at);
+        g.write((const char*) p, (std::streamsize) n);
+        bad = bad || !g;
+        at += n;
+#else
+        const char* c = (const char*) p;
+        while (n > 0 && !bad) {
+            ssize_t k = ::pwrite(fd, c, n, (off_t) at);
+            if (k < 0 && errno == EINTR) {
+                continue;
+            }
+            if (k <= 0) {
+                bad = true;
+                break;
+            }
+            c += k;
+            n -= (size_t) k;
+            at += (uint64_t) k;
+        }
+#endif
+    }
+
+    bool close() {
+        if (!shared) {
+            f.close();
+            return (bool) f;
+        }
+#if defined(_WIN32)
+        g.close();
+        return !bad && (bool) g;
+#else
+        int r = fd >= 0 ? ::close(fd) : -1;
+        fd = -1;
+        return !bad && r == 0;
+#endif
+    }
+};
+
+struct PpmOut : ImageOut {
+    int w = 0, fh = 0;
+    std::string hd;
+    File f;
+
+    PpmOut(const std::string& p, int w0, int h, const OutOpt& o)
+        : w(w0), fh(o.full_h > 0 ? o.full_h : h), hd("P6\n" + std::to_string(w) + " " + std::to_string(fh) + "\n255\n"),
+          f(p, o.full_h > 0, hd.size() + (uint64_t) fh * (uint64_t) w * 3u) {
+        if (f.bad) {
+            throw std::runtime_error("failed to write ppm: " + p);
+        }
+        f.write(hd.data(), hd.size());
+        f.at = hd.size() + (uint64_t) o.y0 * (uint64_t) w * 3u;
+    }
+
+    void rows(const uint8_t* rgb, int n) override {
+        f.write(rgb, (size_t) n * (size_t) w * 3u);
+    }
+
+    void finish() override {
+        if (!f.close()) {
+            throw std::runtime_error("failed to write ppm: " + f.path);
+        }
+    }
+};
+
+void be32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+// Writes filter byte + filtered row to `out`. `up` is the previous raw row or null for the first.
+// Filter 5 tries all five and keeps the one with the smallest sum of |signed bytes|.
+void filter_row(const uint8_t* cur, const uint8_t* up, int n, int bpp, int ft, uint8_t* out, uint8_t* tmp) {
+    int lo = ft, hi = ft;
+    if (ft == 5) {
+        lo = 0;
+        hi = 4;
+    }
+    uint32_t best = 0;
+    for (int f = lo; f <= hi; f++) {
+        uint8_t* o = ft == 5 ? tmp : out;
+        o[0] = (uint8_t) f;
+        uint32_t sum = 0;
+        for (int i = 0; i < n; i++) {
+            int a = i >= bpp ? cur[i - bpp] : 0;
+            int b = up ? up[i] : 0;
+            int c = (up && i >= bpp) ? up[i - bpp] : 0;
+            int p = 0;
+            if (f == 1) {
+                p = a;
+            } else if (f == 2) {
+                p = b;
+            } else if (f == 3) {
+                p = (a + b) >> 1;
+            } else if (f == 4) {
+                p = paeth(a, b, c);
+            }
+            uint8_t v = (uint8_t) (cur[i] - p);
+            o[i + 1] = v;
+            sum += (uint32_t) std::abs((int) (int8_t) v);
+        }
+        if (ft == 5 && (f == lo || sum < best)) {
+            best = sum;
+            std::copy(tmp, tmp + n + 1, out);
+        }
+    }
+}
+
+// Filters and deflates rows in parallel fixed-size chunks, one IDAT per chunk. Each chunk is
+// primed with the 32 KiB before it, and the zlib Adler-32 is combined from the chunks. With
+// OutOpt::pal the image is 8-bit grayscale or palette, one byte per pixel.
+struct PngOut : ImageOut {
+    std::ofstream f;
+    std::string* mem = nullptr;  // encode into this instead of the file
+    std::string path;
+    int w = 0, y = 0, level = 6, ft = 5, threads = 1, ch = 3;
+    uint32_t adler = 1;
+    std::vector<uint8_t> prev, buf;
+    size_t tail = 0;
+    int pend = 0;
+
+    PngOut(const std::string& p, std::string* m, int w0, int h, const OutOpt& o) : mem(m), path(p), w(w0), level(o.png_level), threads(o.threads) {
+        ch = o.pal ? 1 : 3;
+        if (!mem) {
+            f.open(p, std::ios::binary);
+        }
+        static const char* names[] = {"none", "sub", "up", "avg", "paeth", "adaptive"};
+        ft = -1;
+        for (int i = 0; i < 6; i++) {
+            if (lo(o.png_filter) == names[i]) {
+                ft = i;
+            }
+        }
+        if (ft < 0) {
+            throw std::runtime_error("bad --png-filter: " + o.png_filter);
+        }
+        if (!mem && !f) {
+            throw std::runtime_error("png write failed: " + path);
+        }
+        put("\x89PNG\r\n\x1a\n", 8);
+        uint8_t ih[13] = {0};
+        be32(ih, (uint32_t) w);
+        be32(ih + 4, (uint32_t) h);
+        ih[8] = 8;
+        ih[9] = !o.pal ? 2 : o.pal->gray ? 0 : 3;
+        chunk("IHDR", ih, 13);
+        if (o.pal && !o.pal->gray) {
+            std::vector<uint8_t> pl;
+            for (uint32_t c : o.pal->pal) {
+                pl.push_back((uint8_t) c);
+                pl.push_back((uint8_t) (c >> 8));
+                pl.push_back((uint8_t) (c >> 16));
+            }
+            chunk("PLTE", pl.data(), pl.size());
+        }
+        static const uint8_t zh[4][2] = {{0x78, 0x01}, {0x78, 0x5e}, {0x78, 0x9c}, {0x78, 0xda}};
+        chunk("IDAT", zh[level <= 1 ? 0 : level <= 5 ? 1 : level == 6 ? 2 : 3], 2);
+    }
+
+    void put(const void* p, size_t n) {
+        if (mem) {
+            mem->append((const char*) p, n);
+        } else {
+            f.write((const char*) p, (std::streamsize) n);
+        }
+    }
+
+    void chunk(const char* type, const uint8_t* p, size_t n) {
+        chunk(type, p, n, crc32(crc32(0, (const uint8_t*) type, 4), p, n));
+    }
+
+    void chunk(const char* type, const uint8_t* p, size_t n, uint32_t crc) {
+        uint8_t b[4];
+        be32(b, (uint32_t) n);
+        put(b, 4);
+        put(type, 4);
+        put(p, n);
+        be32(b, crc);
+        put(b, 4);
+    }
+
+    // Rows per deflate chunk; a function of the width only, so the file does not depend
+    // on how the rows are batched.
+    int per() const {
+        return std::max(1, (int) (((size_t) 256 << 10) / ((size_t) w * (size_t) ch + 1u)));
+    }
+
+    // Compresses the first nc * per pending rows (or all of them when `all`) and drops
+    // them from `buf`, keeping the last 32 KiB as the next dictionary.
+    void flush(bool all) {
+        size_t fb = (size_t) w * (size_t) ch + 1u;
+        int p = per();
+        int nc = all ? (pend + p - 1) / p : pend / p;
+        if (nc == 0) {
+            return;
+        }
+        std::vector<std::vector<uint8_t>> z((size_t) nc);
+        std::vector<uint32_t> ad((size_t) nc), crc((size_t) nc);
+        auto span = [&](int i, size_t& s, size_t& e) {
+            s = tail + (size_t) i * (size_t) p * fb;
+            e = tail + (size_t) std::min(pend, (i + 1) * p) * fb;
+        };
+        par_for(nc, threads, [&](int i, int) {
+            size_t s = 0, e = 0;
+            span(i, s, e);
+            deflate_chunk(buf.data(), s, e - s, level, z[i]);
+            ad[i] = adler32(1, buf.data() + s, e - s);
+            crc[i] = crc32(crc32(0, (const uint8_t*) "IDAT", 4), z[i].data(), z[i].size());
+        });
+        size_t done = 0;
+        for (int i = 0; i < nc; i++) {
+            size_t s = 0, e = 0;
+            span(i, s, e);
+            adler = adler32_combine(adler, ad[i], e - s);
+            chunk("IDAT", z[i].data(), z[i].size(), crc[i]);
+            done = e;
+        }
+        size_t keep = std::min(done, (size_t) 32768);
+        std::copy(buf.begin() + (std::ptrdiff_t) (done - keep), buf.end(), buf.begin());
+        buf.resize(buf.size() - (done - keep));
+        tail = keep;
+        pend -= std::min(pend, nc * p);
+    }
+
+    void rows(const uint8_t* rgb, int n) override {
+        size_t rb = (size_t) w * (size_t) ch, fb = rb + 1;
+        int p = per();
+        size_t o = tail + (size_t) pend * fb;
+        buf.resize(o + (size_t) n * fb);
+        par_for((n + p - 1) / p, threads, [&](int i, int) {
+            std::vector<uint8_t> tmp(fb);
+            for (int r = i * p; r < std::min(n, (i + 1) * p); r++) {
+                const uint8_t* up = r > 0 ? rgb + (size_t) (r - 1) * rb : (y > 0 ? prev.data() : nullptr);
+                filter_row(rgb + (size_t) r * rb, up, (int) rb, ch, ft, buf.data() + o + (size_t) r * fb, tmp.data());
+            }
+        });
+        pend += n;
+        prev.assign(rgb + (size_t) (n - 1) * rb, rgb + (size_t) n * rb);
+        y += n;
+        flush(false);
+    }
+
+    void finish() override {
+        flush(true);
+        uint8_t end[6] = {0x03, 0x00};
+        be32(end + 2, adler);
+        chunk("IDAT", end, 6);
+        chunk("IEND", nullptr, 0);
+        if (mem) {
+            return;
+        }
+        f.close();
+        if (!f) {
+            throw std::runtime_error("png write failed: " + path);
+        }
+    }
+};
+
+// Encodes strips of whole MCU rows in parallel as they fill up, each one restart interval,
+// and writes them in order with an RSTn marker between each two.
+struct JpegOut : ImageOut {
+    std::ofstream f;
+    std::string path;
+    Jpeg j;
+    int threads = 1, sr = 0, done = 0, pend = 0;
+    std::vector<uint8_t> buf;
+
+    JpegOut(const std::string& p, int w, int h, const OutOpt& o) : path(p), j(w, h, o.jpeg_quality, sub(o)), threads(o.threads) {
+        f.open(p, std::ios::binary);
+        if (!f) {
+            throw std::runtime_error("jpg write failed: " + path);
+        }
+        // MCU rows per strip: about 256K pixels, a function of the width only so the file does
+        // not depend on the thread count, and within the 16-bit restart interval.
+        int k = std::max(1, (int) (((size_t) 256 << 10) / ((size_t) w * (size_t) j.mcu_h())));
+        k = std::min(k, std::max(1, 65535 / j.mcus()));
+        sr = k * j.mcu_h();
+        std::string hd = j.header(k * j.mcus());
+        f.write(hd.data(), (std::streamsize) hd.size());
+    }
+
+    // auto: 4:2:0 up to quality 90, 4:4:4 above.
+    static std::string sub(const OutOpt& o) {
+        if (o.jpeg_sub == "auto") {
+            return o.jpeg_quality <= 90 ? "420" : "444";
+        }
+        return o.jpeg_sub;
+    }
+
+    void flush(bool all) {
+        int nc = all ? (pend + sr - 1) / sr : pend / sr;
+        if (nc == 0) {
+            return;
+        }
+        size_t rb = (size_t) j.w * 3u;
+        std::vector<std::vector<uint8_t>> z((size_t) nc);
+        par_for(nc, threads, [&](int i, int) {
+            int rows = std::min(sr, pend - i * sr);
+            j.strip(buf.data() + (size_t) i * sr * rb, rows, z[(size_t) i]);
+        });
+        for (int i = 0; i < nc; i++) {
+            if (done > 0) {
+                char rst[2] = {(char) 0xFF, (char) (0xD0 + (done - 1) % 8)};
+                f.write(rst, 2);
+            }
+            f.write((const char*) z[(size_t) i].data(), (std::streamsize) z[(size_t) i].size());
+            done++;
+        }
+        int used = std::min(pend, nc * sr);
+        buf.erase(buf.begin(), buf.begin() + (std::ptrdiff_t) ((size_t) used * rb));
+        pend -= used;
+    }
+
+    void rows(const uint8_t* rgb, int n) override {
+        buf.insert(buf.end(), rgb, rgb + (size_t) n * (size_t) j.w * 3u);
+        pend += n;
+        flush(false);
+    }
+
+    void finish() override {
+        flush(true);
+        f.write("\xFF\xD9", 2);
+        f.close();
+        if (!f) {
+            throw std::runtime_error("jpg write failed: " + path);
+        }
+    }
+};
+
+// Rows are formatted in parallel into one buffer, then written in a single call.
+struct CsvOut : FieldOut {
+    std::ofstream f;
+    std::string path;
+    int w = 0, threads = 1;
+    Norm nm;
+    std::vector<char> buf;
+    std::vector<size_t> len;
+
+    CsvOut(const std::string& p, int w0, const Norm& nm0, int t) : f(p, std::ios::binary), path(p), w(w0), threads(t), nm(nm0) {
+        if (!f) {
+            throw std::runtime_error("failed to write csv: " + path);
+        }
+    }
+
+    void rows(const float* v, int n) override {
+        // "0.000000," per value; normalized t never needs more.
+        size_t rb = (size_t) w * 16u + 1u;
+        buf.resize(rb * (size_t) n);
+        len.resize((size_t) n);
+        par_for(n, threads, [&](int y, int) {
+            const float* r = v + (size_t) y * (size_t) w;
+            char* s = buf.data() + rb * (size_t) y;
+            char* p = s;
+            char* e = s + rb;
+            for (int x = 0; x < w; x++) {
+                if (x) {
+                    *p++ = ',';
+                }
+                p = std::to_chars(p, e, (double) nm(r[x]), std::chars_format::fixed, 6).ptr;
+            }
+            *p++ = '\n';
+            len[(size_t) y] = (size_t) (p - s);
+        });
+        size_t o = 0;
+        for (int y = 0; y < n; y++) {
+            std::memmove(buf.data() + o, buf.data() + rb * (size_t) y, len[(size_t) y]);
+            o += len[(size_t) y];
+        }
+        f.write(buf.data(), (std::streamsize) o);
+    }
+
+    void finish() override {
+        f.close();
+        if (!f) {
+            throw std::runtime_error("failed to write csv: " + path);
+        }
+    }
+};
+
+// float32 or uint16 samples, little-endian, row-major. uint16 maps t in [0,1] to 0..65535.
+// With `npy` a version 1.0 header describing a (h, w) C-order array comes first.
+struct BinOut : FieldOut {
+    std::string path;
+    int w = 0, threads = 1;
+    Norm nm;
+    bool u16 = false, raw_h = false;
+    std::string hd;
+    File f;
+    std::vector<uint8_t> buf;
+
+    BinOut(const std::string& p, bool npy, int w0, int h, const Norm& nm0, bool u, bool rh, const OutOpt& o)
+        : path(p), w(w0), threads(o.threads), nm(nm0), u16(u), raw_h(rh), hd(npy ? npy_hdr(u, o.full_h > 0 ? o.full_h : h, w0) : ""),
+          f(p, o.full_h > 0, hd.size() + (uint64_t) o.full_h * (uint64_t) w0 * (u ? 2u : 4u)) {
+        if (f.bad) {
+            throw std::runtime_error("failed to write " + path);
+        }
+        f.write(hd.data(), hd.size());
+        f.at = hd.size() + (uint64_t) o.y0 * (uint64_t) w * (u16 ? 2u : 4u);
+    }
+
+    static std::string npy_hdr(bool u16, int h, int w) {
+        std::string d = "{'descr': '" + std::string(u16 ? "<u2" : "<f4") + "', 'fortran_order': False, 'shape': (" + std::to_string(h) + ", " + std::to_string(w) + "), }";
+        while ((10 + d.size() + 1) % 64) {
+            d += ' ';
+        }
+        d += '\n';
+        const char hd[10] = {(char) 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0, (char) (uint8_t) d.size(), (char) (uint8_t) (d.size() >> 8)};
+        return std::string(hd, 10) + d;
+    }
+
+    void rows(const float* v, int n) override {
+        size_t cnt = (size_t) n * (size_t) w;
+        size_t sz = u16 ? 2u : 4u;
+        buf.resize(cnt * sz);
+        par_for(n, threads, [&](int y, int) {
+            size_t i0 = (size_t) y * (size_t) w;
+            for (size_t i = i0; i < i0 + (size_t) w; i++) {
+                uint8_t* p = buf.data() + i * sz;
+                if (u16) {
+                    uint32_t q = (uint32_t) (nm(v[i]) * 65535.0f + 0.5f);
+                    p[0] = (uint8_t) q;
+                    p[1] = (uint8_t) (q >> 8);
+                } else {
+                    float t = raw_h ? v[i] : nm(v[i]);
+                    uint32_t q;
+                    std::memcpy(&q, &t, 4);
+                    p[0] = (uint8_t) q;
+                    p[1] = (uint8_t) (q >> 8);
+                    p[2] = (uint8_t) (q >> 16);
+                    p[3] = (uint8_t) (q >> 24);
+                }
+            }
+        });
+        f.write(buf.data(), buf.size());
+    }
+
+    void finish() override {
+        if (!f.close()) {
+            throw std::runtime_error("failed to write " + path);
+        }
+    }
+};
+
+}
+
+std::unique_ptr<ImageOut> ImageOut::open(const std::string& path, const std::string& fmt, int w, int h, const OutOpt& o) {
+    if (o.pal && fmt != "png") {
+        throw std::runtime_error("only png can be written from palette indices, not " + fmt);
+    }
+    if (fmt == "ppm") {
+        return std::make_unique<PpmOut>(path, w, h, o);
+    }
+    if (o.full_h > 0) {
+        throw std::runtime_error("only ppm images can be written in parts, not " + fmt);
+    }
+    if (fmt == "png") {
+        return std::make_unique<PngOut>(path, nullptr, w, h, o);
+    }
+    if (fmt == "jpg" || fmt == "jpeg") {
+        return std::make_unique<JpegOut>(path, w, h, o);
+    }
+    throw std::runtime_error("bad format: " + fmt);
+}
+
+std::unique_ptr<ImageOut> ImageOut::open_mem(std::string& dst, const std::string& fmt, int w, int h, const OutOpt& o) {
+    if (fmt != "png") {
+        throw std::runtime_error("only png can be encoded to memory, not " + fmt);
+    }
+    dst.clear();
+    return std::make_unique<PngOut>("(memory)", &dst, w, h, o);
+}
+
+std::unique_ptr<FieldOut> FieldOut::open(const std::string& path, const std::string& kind, int w, int h, const Norm& nm, const OutOpt& o) {
+    if (kind == "csv") {
+        if (o.full_h > 0) {
+            throw std::runtime_error("csv cannot be written in parts");
+        }
+        return std::make_unique<CsvOut>(path, w, nm, o.threads);
+    }
+    std::string dt = lo(o.dtype), fl = lo(o.field);
+    if (dt != "float32" && dt != "uint16") {
+        throw std::runtime_error("bad --dtype: " + o.dtype);
+    }
+    if (fl != "t" && fl != "h") {
+        throw std::runtime_error("bad --field: " + o.field);
+    }
+    if (dt == "uint16" && fl == "h") {
+        throw std::runtime_error("--dtype uint16 needs --field t");
+    }
+    return std::make_unique<BinOut>(path, kind == "npy", w, h, nm, dt == "uint16", fl == "h", o);
+}
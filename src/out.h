@@ -0,0 +1,41 @@
+#pragma once
+#include "colormap.h"
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct OutOpt {
+    int threads = 1;
+    int png_level = 6;
+    std::string png_filter = "adaptive";
+    int jpeg_quality = 95;
+    std::string jpeg_sub = "auto";  // auto, 444, 422 or 420
+    std::string dtype = "float32";
+    std::string field = "t";
+    // full_h > 0: the h rows are rows y0 on of an image full_h tall, written at their offset
+    // into a file other processes may be writing the rest of. PPM, raw and npy only.
+    int y0 = 0, full_h = 0;
+    // png only: rows are one byte per pixel, Palette::ix indices (gray levels when pal->gray).
+    const Palette* pal = nullptr;
+};
+
+// Receives the RGB image (or OutOpt::pal indices) top to bottom, a band of rows at a time.
+struct ImageOut {
+    virtual ~ImageOut() = default;
+    virtual void rows(const uint8_t* rgb, int n) = 0;
+    virtual void finish() = 0;
+    static std::unique_ptr<ImageOut> open(const std::string& path, const std::string& fmt, int w, int h, const OutOpt& o);
+    // The same encoder appending to dst (png only); dst is complete after finish().
+    static std::unique_ptr<ImageOut> open_mem(std::string& dst, const std::string& fmt, int w, int h, const OutOpt& o);
+};
+
+// Receives the sampled heightfield top to bottom, a band of rows at a time. `kind` is csv
+// (normalized t as text), raw (headerless little-endian) or npy.
+struct FieldOut {
+    virtual ~FieldOut() = default;
+    virtual void rows(const float* v, int n) = 0;
+    virtual void finish() = 0;
+    static std::unique_ptr<FieldOut> open(const std::string& path, const std::string& kind, int w, int h, const Norm& nm, const OutOpt& o);
+};
@@ -0,0 +1,177 @@
+#include "par.h"
+#include "util.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+int hw_threads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : (int) n;
+}
+
+namespace {
+
+struct Slot {
+    std::mutex m;
+    int lo = 0;
+    int hi = 0;
+};
+
+// One par_for call. The caller is worker 0 and queues one entry per helper; whichever pool
+// thread pops an entry becomes the next worker. Once the caller's own loop finds every
+// slice empty it closes the job, so entries still queued run nothing and it waits only for
+// helpers already inside f. Nested and concurrent calls therefore never wait on a thread
+// that is not running their work.
+struct Job {
+    std::mutex m;
+    std::condition_variable cv;
+    std::function<void(int)> work;
+    int next = 1;
+    int live = 0;
+    bool closed = false;
+};
+
+// Threads started on first use and grown to the most helpers any call has asked for.
+struct Pool {
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<Job>> q;
+    std::vector<std::thread> ts;
+    bool quit = false;
+
+    ~Pool() {
+        {
+            std::lock_guard<std::mutex> g(m);
+            quit = true;
+        }
+        cv.notify_all();
+        for (std::thread& t : ts) {
+            t.join();
+        }
+    }
+
+    void submit(const std::shared_ptr<Job>& j, int helpers) {
+        {
+            std::lock_guard<std::mutex> g(m);
+            while ((int) ts.size() < helpers) {
+                ts.emplace_back([this] { loop(); });
+            }
+            for (int i = 0; i < helpers; i++) {
+                q.push_back(j);
+            }
+        }
+        cv.notify_all();
+    }
+
+    void loop() {
+        for (;;) {
+            std::shared_ptr<Job> j;
+            {
+                std::unique_lock<std::mutex> g(m);
+                cv.wait(g, [this] { return quit || !q.empty(); });
+                if (q.empty()) {
+                    return;
+                }
+                j = std::move(q.front());
+                q.pop_front();
+            }
+            int t;
+            {
+                std::lock_guard<std::mutex> g(j->m);
+                if (j->closed) {
+                    continue;
+                }
+                t = j->next++;
+                j->live++;
+            }
+            j->work(t);
+            {
+                std::lock_guard<std::mutex> g(j->m);
+                j->live--;
+            }
+            j->cv.notify_all();
+        }
+    }
+};
+
+Pool& pool() {
+    static Pool p;
+    return p;
+}
+
+}
+
+void par_for(int n, int threads, const std::function<void(int, int)>& f) {
+    if (n <= 0) {
+        return;
+    }
+    threads = clampv(threads, 1, n);
+    if (threads == 1) {
+        for (int i = 0; i < n; i++) {
+            f(i, 0);
+        }
+        return;
+    }
+    std::vector<Slot> q(threads);
+    for (int t = 0; t < threads; t++) {
+        q[t].lo = (int) ((long long) n * t / threads);
+        q[t].hi = (int) ((long long) n * (t + 1) / threads);
+    }
+    auto take = [&](int t, int& i) -> bool {
+        Slot& me = q[t];
+        {
+            std::lock_guard<std::mutex> g(me.m);
+            if (me.lo < me.hi) {
+                i = me.lo++;
+                return true;
+            }
+        }
+        for (int k = 1; k < threads; k++) {
+            Slot& v = q[(t + k) % threads];
+            std::scoped_lock g(me.m, v.m);
+            if (v.lo < v.hi) {
+                int mid = v.lo + (v.hi - v.lo) / 2;
+                i = mid;
+                me.lo = mid + 1;
+                me.hi = v.hi;
+                v.hi = mid;
+                return true;
+            }
+        }
+        return false;
+    };
+    std::atomic<bool> stop{false};
+    std::exception_ptr err;
+    std::mutex em;
+    auto work = [&](int t) {
+        int i = 0;
+        while (!stop.load(std::memory_order_relaxed) && take(t, i)) {
+            try {
+                f(i, t);
+            } catch (...) {
+                std::lock_guard<std::mutex> g(em);
+                if (!err) {
+                    err = std::current_exception();
+                }
+                stop = true;
+            }
+        }
+    };
+    auto j = std::make_shared<Job>();
+    j->work = work;
+    pool().submit(j, threads - 1);
+    work(0);
+    {
+        std::unique_lock<std::mutex> g(j->m);
+        j->closed = true;
+        j->cv.wait(g, [&] { return j->live == 0; });
+    }
+    if (err) {
+        std::rethrow_exception(err);
+    }
+}
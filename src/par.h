@@ -0,0 +1,11 @@
+#pragma once
+#include <functional>
+
+int hw_threads();
+
+// Runs f(i, tid) for every i in [0, n) on up to `threads` workers (tid is in
+// [0, threads)). Each worker starts on its own contiguous slice of indices and
+// steals half of another worker's remaining slice once it runs dry. The first
+// exception thrown by f is rethrown on the calling thread. The helpers come from a
+// process-wide pool started on first use, so calls do not create threads.
+void par_for(int n, int threads, const std::function<void(int, int)>& f);
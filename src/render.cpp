@@ -0,0 +1,2022 @@
+#include "render.h"
+#include "cache.h"
+#include "out.h"
+#include "par.h"
+#include "simd.h"
+#include "trace.h"
+#include "util.h"
+#include "FastNoiseLite.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+static FastNoiseLite::NoiseType nt(const std::string& s) {
+    std::string t = lo(s);
+    if (t == "opensimplex2") {
+        return FastNoiseLite::NoiseType_OpenSimplex2;
+    }
+    if (t == "opensimplex2s") {
+        return FastNoiseLite::NoiseType_OpenSimplex2S;
+    }
+    if (t == "simplex") {
+        return FastNoiseLite::NoiseType_OpenSimplex2S;
+    }
+    if (t == "perlin") {
+        return FastNoiseLite::NoiseType_Perlin;
+    }
+    if (t == "value") {
+        return FastNoiseLite::NoiseType_Value;
+    }
+    if (t == "valuecubic") {
+        return FastNoiseLite::NoiseType_ValueCubic;
+    }
+    if (t == "cellular") {
+        return FastNoiseLite::NoiseType_Cellular;
+    }
+    throw std::runtime_error("bad --type: " + s);
+}
+
+static FastNoiseLite::RotationType3D rt3(const std::string& s) {
+    std::string t = lo(s);
+    if (t == "none") {
+        return FastNoiseLite::RotationType3D_None;
+    }
+    if (t == "improvexyplanes") {
+        return FastNoiseLite::RotationType3D_ImproveXYPlanes;
+    }
+    if (t == "improvexzplanes") {
+        return FastNoiseLite::RotationType3D_ImproveXZPlanes;
+    }
+    throw std::runtime_error("bad --rotation3d: " + s);
+}
+
+static FastNoiseLite::FractalType ft(const std::string& s) {
+    std::string t = lo(s);
+    if (t == "none") {
+        return FastNoiseLite::FractalType_None;
+    }
+    if (t == "fbm") {
+        return FastNoiseLite::FractalType_FBm;
+    }
+    if (t == "rigid") {
+        return FastNoiseLite::FractalType_Ridged;
+    }
+    if (t == "pingpong") {
+        return FastNoiseLite::FractalType_PingPong;
+    }
+    throw std::runtime_error("bad --fractal-type: " + s);
+}
+
+static FastNoiseLite::CellularDistanceFunction cdf(const std::string& s) {
+    std::string t = lo(s);
+    if (t == "euclidean") {
+        return FastNoiseLite::CellularDistanceFunction_Euclidean;
+    }
+    if (t == "euclideansq") {
+        return FastNoiseLite::CellularDistanceFunction_EuclideanSq;
+    }
+    if (t == "manhattan") {
+        return FastNoiseLite::CellularDistanceFunction_Manhattan;
+    }
+    if (t == "hybrid") {
+        return FastNoiseLite::CellularDistanceFunction_Hybrid;
+    }
+    throw std::runtime_error("bad --cell-dist: " + s);
+}
+
+static FastNoiseLite::CellularReturnType crt(const std::string& s) {
+    std::string t = lo(s);
+    if (t == "cellvalue") {
+        return FastNoiseLite::CellularReturnType_CellValue;
+    }
+    if (t == "distance") {
+        return FastNoiseLite::CellularReturnType_Distance;
+    }
+    if (t == "distance2") {
+        return FastNoiseLite::CellularReturnType_Distance2;
+    }
+    if (t == "distance2add") {
+        return FastNoiseLite::CellularReturnType_Distance2Add;
+    }
+    if (t == "distance2sub") {
+        return FastNoiseLite::CellularReturnType_Distance2Sub;
+    }
+    if (t == "distance2mul") {
+        return FastNoiseLite::CellularReturnType_Distance2Mul;
+    }
+    if (t == "distance2div") {
+        return FastNoiseLite::CellularReturnType_Distance2Div;
+    }
+    throw std::runtime_error("bad --cell-return: " + s);
+}
+
+static std::string warp_nt(const std::string& s) {
+    std::string t = lo(s);
+    if (t == "opensimplex2") {
+        return "OpenSimplex2";
+    }
+    if (t == "opensimplex2reduced") {
+        return "OpenSimplex2S";
+    }
+    if (t == "basicgrid") {
+        return "Value";
+    }
+    throw std::runtime_error("bad --warp-type: " + s);
+}
+
+static FastNoiseLite::DomainWarpType dwt(const std::string& s) {
+    std::string t = lo(s);
+    if (t == "opensimplex2") {
+        return FastNoiseLite::DomainWarpType_OpenSimplex2;
+    }
+    if (t == "opensimplex2reduced") {
+        return FastNoiseLite::DomainWarpType_OpenSimplex2Reduced;
+    }
+    if (t == "basicgrid") {
+        return FastNoiseLite::DomainWarpType_BasicGrid;
+    }
+    throw std::runtime_error("bad --warp-type: " + s);
+}
+
+static std::string fmt_of(const Cfg& c) {
+    if (!c.fmt.empty()) {
+        return lo(c.fmt);
+    }
+    std::string e = ext_of(c.out);
+    if (e == "png" || e == "jpg" || e == "jpeg" || e == "ppm") {
+        return e;
+    }
+    return "png";
+}
+
+enum class Warp { Off, Single, Progressive, Independent };
+
+static Warp warp_mode(const Cfg& c) {
+    if (!c.warp) {
+        return Warp::Off;
+    }
+    std::string t = lo(c.warp_fract);
+    if (t == "none") {
+        return Warp::Single;
+    }
+    if (t == "domainwarpprogressive") {
+        return Warp::Progressive;
+    }
+    if (t == "domainwarpindependent") {
+        return Warp::Independent;
+    }
+    throw std::runtime_error("bad --warp-fractal-type: " + c.warp_fract);
+}
+
+enum class Tiling { Off, Blend, Torus };
+
+static bool has4(FastNoiseLite::NoiseType t) {
+    return t == FastNoiseLite::NoiseType_OpenSimplex2 || t == FastNoiseLite::NoiseType_OpenSimplex2S ||
+           t == FastNoiseLite::NoiseType_Perlin || t == FastNoiseLite::NoiseType_Value;
+}
+
+static Tiling tiling(const Cfg& c) {
+    if (!c.tile) {
+        return Tiling::Off;
+    }
+    std::string t = lo(c.tile_mode);
+    if (t == "blend") {
+        return Tiling::Blend;
+    }
+    if (t != "torus") {
+        throw std::runtime_error("bad --tile-mode: " + c.tile_mode);
+    }
+    if (!has4(nt(c.type))) {
+        throw std::runtime_error("--tile-mode torus needs --type OpenSimplex2, OpenSimplex2S, Perlin or Value");
+    }
+    if (c.warp && !has4(nt(warp_nt(c.warp_type)))) {
+        throw std::runtime_error("--tile-mode torus does not support --warp-type " + c.warp_type);
+    }
+    if (c.z != 0.0f) {
+        throw std::runtime_error("--tile-mode torus does not support --z");
+    }
+    return Tiling::Torus;
+}
+
+// Floor division and its remainder in [0, b), for world coordinates left of or above 0.
+static int fdiv(int a, int b) {
+    int q = a / b;
+    return q * b > a ? q - 1 : q;
+}
+
+static int pmod(int a, int b) {
+    return a - fdiv(a, b) * b;
+}
+
+// Scratch for the columns [x0, x0 + w) of one row; init() sizes it for the widest span.
+struct Row {
+    int x0 = 0, w = 0;
+    Isa isa = Isa::Scalar;
+    int tp = 0;  // period whose unwarped torus columns are cached in a/b (0: none)
+    std::vector<float> x, y, z, u, tx, ty, qx, qy, a, b, c, d, dx, dy, sx, sy;
+
+    void init(int w0, float z0, Isa isa0) {
+        x0 = 0;
+        w = w0;
+        isa = isa0;
+        tp = 0;
+        for (std::vector<float>* v : {&x, &y, &u, &tx, &ty, &qx, &qy, &a, &b, &c, &d, &dx, &dy, &sx, &sy}) {
+            v->assign((size_t) w, 0.0f);
+        }
+        z.assign((size_t) w, z0);
+    }
+
+    void span(int x1, int w1) {
+        if (x1 != x0 || w1 != w) {
+            x0 = x1;
+            w = w1;
+            tp = 0;
+        }
+    }
+};
+
+// Flat: every y is the same (an unwarped row), so the scanline evaluator applies.
+template <bool Use3, bool Flat = false>
+static void val(const FastNoiseLite& n, Row& r, const float* x, const float* y, float* out) {
+    if constexpr (Use3 && Flat) {
+        noise_row(n, x, y, r.z.data(), out, r.w, r.isa);
+    } else if constexpr (Use3) {
+        noise_batch(n, x, y, r.z.data(), out, r.w, r.isa);
+    } else if constexpr (Flat) {
+        noise_row(n, x, y, out, r.w, r.isa);
+    } else {
+        noise_batch(n, x, y, out, r.w, r.isa);
+    }
+}
+
+template <bool Use3, bool Flat = false>
+static void tile4(const FastNoiseLite& n, Row& r, const float* x, const float* y, float p, float v, float* out) {
+    for (int i = 0; i < r.w; i++) {
+        r.qx[i] = x[i] - p;
+        r.qy[i] = y[i] - p;
+    }
+    val<Use3, Flat>(n, r, x, y, r.a.data());
+    val<Use3, Flat>(n, r, r.qx.data(), y, r.b.data());
+    val<Use3, Flat>(n, r, x, r.qy.data(), r.c.data());
+    val<Use3, Flat>(n, r, r.qx.data(), r.qy.data(), r.d.data());
+    for (int i = 0; i < r.w; i++) {
+        float u = r.u[i];
+        float ab = r.a[i] + (r.b[i] - r.a[i]) * u;
+        float cd = r.c[i] + (r.d[i] - r.c[i]) * u;
+        out[i] = ab + (cd - ab) * v;
+    }
+}
+
+static const float tau = 6.28318530717958648f;
+
+// Wraps each axis of period p onto a circle of circumference p and samples the 4D noise
+// once on the resulting torus, so distances (and the frequency) match the flat plane.
+static void torus4(const FastNoiseLite& n, Row& r, const float* x, const float* y, float p, float* out) {
+    float k = tau / p;
+    float rad = p / tau;
+    for (int i = 0; i < r.w; i++) {
+        float a = x[i] * k;
+        float b = y[i] * k;
+        r.a[i] = rad * std::cos(a);
+        r.b[i] = rad * std::sin(a);
+        r.c[i] = rad * std::cos(b);
+        r.d[i] = rad * std::sin(b);
+    }
+    r.tp = 0;
+    noise_batch(n, r.a.data(), r.b.data(), r.c.data(), r.d.data(), out, r.w, r.isa);
+}
+
+template <Tiling T, bool Use3>
+static void samp(const FastNoiseLite& n, Row& r, const float* x, const float* y, float p, float v, float* out) {
+    if constexpr (T == Tiling::Blend) {
+        tile4<Use3>(n, r, x, y, p, v, out);
+    } else if constexpr (T == Tiling::Torus) {
+        torus4(n, r, x, y, p, out);
+    } else {
+        val<Use3>(n, r, x, y, out);
+    }
+}
+
+// Legacy engine: x and y displacements from two noise instances (seeds s and s + 1).
+template <Tiling T, Warp W, bool Use3>
+static void warp_legacy(const FastNoiseLite& nx, const FastNoiseLite& ny, Row& r, const Cfg& c, float p, float v) {
+    constexpr bool indep = W == Warp::Independent;
+    int oct = W == Warp::Single ? 1 : c.warp_oct;
+    if constexpr (indep) {
+        std::fill(r.sx.begin(), r.sx.begin() + r.w, 0.0f);
+        std::fill(r.sy.begin(), r.sy.begin() + r.w, 0.0f);
+    }
+    float f = 1.0f;
+    float a = c.warp_amp;
+    for (int o = 0; o < oct; o++) {
+        for (int i = 0; i < r.w; i++) {
+            r.tx[i] = r.x[i] * f;
+            r.ty[i] = r.y[i] * f;
+        }
+        samp<T, Use3>(nx, r, r.tx.data(), r.ty.data(), p * f, v, r.dx.data());
+        samp<T, Use3>(ny, r, r.tx.data(), r.ty.data(), p * f, v, r.dy.data());
+        if constexpr (indep) {
+            for (int i = 0; i < r.w; i++) {
+                r.sx[i] += r.dx[i] * a;
+                r.sy[i] += r.dy[i] * a;
+            }
+        } else {
+            for (int i = 0; i < r.w; i++) {
+                r.x[i] += r.dx[i] * a;
+                r.y[i] += r.dy[i] * a;
+            }
+        }
+        a *= c.warp_gain;
+        f *= c.warp_lac;
+    }
+    if constexpr (indep) {
+        for (int i = 0; i < r.w; i++) {
+            r.x[i] += r.sx[i];
+            r.y[i] += r.sy[i];
+        }
+    }
+}
+
+// Both displacements of warp octave o at (x, y) into r.dx/r.dy. Tiled modes blend the four
+// period-shifted lookups with the tile4 weights, which keeps the warp field periodic.
+template <Tiling T>
+static void wsamp(const FastNoiseLite& n, int o, Row& r, const float* x, const float* y, float p, float v) {
+    if constexpr (T == Tiling::Off) {
+        warp_batch(n, o, x, y, r.dx.data(), r.dy.data(), r.w, r.isa);
+    } else {
+        for (int i = 0; i < r.w; i++) {
+            r.qx[i] = x[i] - p;
+            r.qy[i] = y[i] - p;
+        }
+        warp_batch(n, o, x, y, r.a.data(), r.b.data(), r.w, r.isa);
+        warp_batch(n, o, r.qx.data(), y, r.c.data(), r.d.data(), r.w, r.isa);
+        for (int i = 0; i < r.w; i++) {
+            float u = r.u[i];
+            r.dx[i] = r.a[i] + (r.c[i] - r.a[i]) * u;
+            r.dy[i] = r.b[i] + (r.d[i] - r.b[i]) * u;
+        }
+        warp_batch(n, o, x, r.qy.data(), r.a.data(), r.b.data(), r.w, r.isa);
+        warp_batch(n, o, r.qx.data(), r.qy.data(), r.c.data(), r.d.data(), r.w, r.isa);
+        for (int i = 0; i < r.w; i++) {
+            float u = r.u[i];
+            float cx = r.a[i] + (r.c[i] - r.a[i]) * u;
+            float cy = r.b[i] + (r.d[i] - r.b[i]) * u;
+            r.dx[i] = r.dx[i] + (cx - r.dx[i]) * v;
+            r.dy[i] = r.dy[i] + (cy - r.dy[i]) * v;
+        }
+    }
+}
+
+// Fused engine: FastNoiseLite::DomainWarp(x, y) with `n`'s warp settings, both axes from
+// one gradient lookup per octave. Untiled rows match DomainWarp exactly.
+template <Tiling T, Warp W>
+static void warp_fused(const FastNoiseLite& n, Row& r, const Cfg& c, float p, float v) {
+    int oct = W == Warp::Single ? 1 : c.warp_oct;
+    const float* x = r.x.data();
+    const float* y = r.y.data();
+    if constexpr (W == Warp::Independent) {
+        std::copy(r.x.begin(), r.x.begin() + r.w, r.tx.begin());
+        std::copy(r.y.begin(), r.y.begin() + r.w, r.ty.begin());
+        x = r.tx.data();
+        y = r.ty.data();
+    }
+    for (int o = 0; o < oct; o++) {
+        wsamp<T>(n, o, r, x, y, p, v);
+        for (int i = 0; i < r.w; i++) {
+            r.x[i] += r.dx[i];
+            r.y[i] += r.dy[i];
+        }
+    }
+}
+
+// Warps the row coordinates r.x/r.y in place. `v` is the row's tile blend weight.
+template <Tiling T, Warp W, bool Fz, bool Use3>
+static void warp_apply(const FastNoiseLite& wx, const FastNoiseLite& wy, Row& r, const Cfg& c, float p, float v) {
+    if constexpr (Fz) {
+        warp_fused<T, W>(wx, r, c, p, v);
+    } else {
+        warp_legacy<T, W, Use3>(wx, wy, r, c, p, v);
+    }
+}
+
+template <Tiling T, Warp W, bool Fz, bool Use3>
+static void sample_row(const FastNoiseLite& n, const FastNoiseLite& wx, const FastNoiseLite& wy, Row& r, const Cfg& c, int y, float* out) {
+    if constexpr (T == Tiling::Off) {
+        for (int x = 0; x < r.w; x++) {
+            r.x[x] = (float) (r.x0 + x);
+            r.y[x] = (float) y;
+        }
+        if constexpr (W != Warp::Off) {
+            warp_apply<T, W, Fz, Use3>(wx, wy, r, c, 0.0f, 0.0f);
+        }
+        val<Use3, W == Warp::Off>(n, r, r.x.data(), r.y.data(), out);
+    } else if constexpr (T == Tiling::Torus) {
+        int p = c.tile_p;
+        float yi = (float) (p <= 0 ? 0 : pmod(y, p));
+        float per = (float) p;
+        for (int x = 0; x < r.w; x++) {
+            r.x[x] = (float) (p <= 0 ? 0 : pmod(r.x0 + x, p));
+            r.y[x] = yi;
+            r.u[x] = r.x[x] / per;
+        }
+        if constexpr (W != Warp::Off) {
+            warp_apply<T, W, Fz, Use3>(wx, wy, r, c, per, yi / per);
+            torus4(n, r, r.x.data(), r.y.data(), per, out);
+        } else {
+            // Unwarped columns are the same on every row: only the row circle changes.
+            float k = tau / per;
+            float rad = per / tau;
+            if (r.tp != p) {
+                for (int x = 0; x < r.w; x++) {
+                    r.a[x] = rad * std::cos(r.x[x] * k);
+                    r.b[x] = rad * std::sin(r.x[x] * k);
+                }
+                r.tp = p;
+            }
+            std::fill(r.c.begin(), r.c.begin() + r.w, rad * std::cos(yi * k));
+            std::fill(r.d.begin(), r.d.begin() + r.w, rad * std::sin(yi * k));
+            noise_batch(n, r.a.data(), r.b.data(), r.c.data(), r.d.data(), out, r.w, r.isa);
+        }
+    } else {
+        int p = c.tile_p;
+        int yi = p <= 0 ? 0 : pmod(y, p);
+        float v0 = (p <= 1) ? 0.0f : (float) yi / (float) (p - 1);
+        float per = (float) p;
+        for (int x = 0; x < r.w; x++) {
+            int xi = p <= 0 ? 0 : pmod(r.x0 + x, p);
+            float u = (p <= 1) ? 0.0f : (float) xi / (float) (p - 1);
+            r.u[x] = u;
+            r.x[x] = u * per;
+            r.y[x] = v0 * per;
+        }
+        if constexpr (W != Warp::Off) {
+            warp_apply<T, W, Fz, Use3>(wx, wy, r, c, per, v0);
+        }
+        tile4<Use3, W == Warp::Off>(n, r, r.x.data(), r.y.data(), per, v0, out);
+    }
+}
+
+using RowFn = void (*)(const FastNoiseLite&, const FastNoiseLite&, const FastNoiseLite&, Row&, const Cfg&, int, float*);
+
+template <Tiling T, Warp W>
+static RowFn row_fn(bool fused, bool use3) {
+    if (fused) {
+        return use3 ? sample_row<T, W, true, true> : sample_row<T, W, true, false>;
+    }
+    return use3 ? sample_row<T, W, false, true> : sample_row<T, W, false, false>;
+}
+
+template <Tiling T>
+static RowFn row_fn(Warp w, bool fused, bool use3) {
+    switch (w) {
+    case Warp::Single:
+        return row_fn<T, Warp::Single>(fused, use3);
+    case Warp::Progressive:
+        return row_fn<T, Warp::Progressive>(fused, use3);
+    case Warp::Independent:
+        return row_fn<T, Warp::Independent>(fused, use3);
+    default:
+        return row_fn<T, Warp::Off>(false, use3);
+    }
+}
+
+static RowFn row_fn(Tiling t, Warp w, bool fused, bool use3) {
+    switch (t) {
+    case Tiling::Blend:
+        return row_fn<Tiling::Blend>(w, fused, use3);
+    case Tiling::Torus:
+        return row_fn<Tiling::Torus>(w, fused, use3);
+    default:
+        return row_fn<Tiling::Off>(w, fused, use3);
+    }
+}
+
+Cfg cfg_from(const Args& a) {
+    Cfg c;
+    if (a.has("width")) {
+        if (!parse_i(a.get1("width", ""), c.w) || c.w <= 0) {
+            throw std::runtime_error("bad --width");
+        }
+    }
+    if (a.has("height")) {
+        if (!parse_i(a.get1("height", ""), c.h) || c.h <= 0) {
+            throw std::runtime_error("bad --height");
+        }
+    }
+    if (a.has("seed")) {
+        if (!parse_i(a.get1("seed", ""), c.seed)) {
+            throw std::runtime_error("bad --seed");
+        }
+    }
+    if (a.has("freq") || a.has("scale")) {
+        std::string v = a.has("freq") ? a.get1("freq", "") : a.get1("scale", "");
+        if (!parse_f(v, c.freq) || c.freq <= 0.0f) {
+            throw std::runtime_error("bad --freq/--scale");
+        }
+    }
+    if (a.has("z")) {
+        if (!parse_f(a.get1("z", ""), c.z)) {
+            throw std::runtime_error("bad --z");
+        }
+    }
+    if (a.has("offset-x")) {
+        if (!parse_i(a.get1("offset-x", ""), c.ox)) {
+            throw std::runtime_error("bad --offset-x");
+        }
+    }
+    if (a.has("offset-y")) {
+        if (!parse_i(a.get1("offset-y", ""), c.oy)) {
+            throw std::runtime_error("bad --offset-y");
+        }
+    }
+    if (a.has("type")) {
+        c.type = a.get1("type", c.type);
+    }
+    if (a.has("rotation3d")) {
+        c.rot3 = a.get1("rotation3d", c.rot3);
+    }
+    if (a.has("tile")) {
+        c.tile = true;
+    }
+    c.tile_p = c.w;
+    if (a.has("tile-period")) {
+        if (!parse_i(a.get1("tile-period", ""), c.tile_p) || c.tile_p <= 0) {
+            throw std::runtime_error("bad --tile-period");
+        }
+    }
+    if (a.has("tile-mode")) {
+        c.tile_mode = a.get1("tile-mode", c.tile_mode);
+    }
+    if (a.has("fractal-type")) {
+        c.fract = a.get1("fractal-type", c.fract);
+    }
+    if (a.has("octaves")) {
+        if (!parse_i(a.get1("octaves", ""), c.oct) || c.oct < 1) {
+            throw std::runtime_error("bad --octaves");
+        }
+    }
+    if (a.has("gain")) {
+        if (!parse_f(a.get1("gain", ""), c.gain)) {
+            throw std::runtime_error("bad --gain");
+        }
+    }
+    if (a.has("lacunarity")) {
+        if (!parse_f(a.get1("lacunarity", ""), c.lac)) {
+            throw std::runtime_error("bad --lacunarity");
+        }
+    }
+    if (a.has("weighted-strength")) {
+        if (!parse_f(a.get1("weighted-strength", ""), c.wstr)) {
+            throw std::runtime_error("bad --weighted-strength");
+        }
+    }
+    if (a.has("pingpong-strength")) {
+        if (!parse_f(a.get1("pingpong-strength", ""), c.pp)) {
+            throw std::runtime_error("bad --pingpong-strength");
+        }
+    }
+    if (a.has("octave-cutoff")) {
+        c.oct_cut = a.get1("octave-cutoff", c.oct_cut);
+    }
+    if (a.has("cell-dist")) {
+        c.cell_dist = a.get1("cell-dist", c.cell_dist);
+    }
+    if (a.has("cell-return")) {
+        c.cell_ret = a.get1("cell-return", c.cell_ret);
+    }
+    if (a.has("cell-jitter")) {
+        if (!parse_f(a.get1("cell-jitter", ""), c.cell_j)) {
+            throw std::runtime_error("bad --cell-jitter");
+        }
+    }
+    if (a.has("warp")) {
+        c.warp = true;
+    }
+    if (a.has("warp-type")) {
+        c.warp_type = a.get1("warp-type", c.warp_type);
+    }
+    c.warp_seed = c.seed + 1;
+    if (a.has("warp-seed")) {
+        if (!parse_i(a.get1("warp-seed", ""), c.warp_seed)) {
+            throw std::runtime_error("bad --warp-seed");
+        }
+    }
+    c.warp_freq = c.freq;
+    if (a.has("warp-freq")) {
+        if (!parse_f(a.get1("warp-freq", ""), c.warp_freq) || c.warp_freq <= 0.0f) {
+            throw std::runtime_error("bad --warp-freq");
+        }
+    }
+    c.warp_rot3 = c.rot3;
+    if (a.has("warp-rotation3d")) {
+        c.warp_rot3 = a.get1("warp-rotation3d", c.warp_rot3);
+    }
+    if (a.has("warp-amp")) {
+        if (!parse_f(a.get1("warp-amp", ""), c.warp_amp)) {
+            throw std::runtime_error("bad --warp-amp");
+        }
+    }
+    if (a.has("warp-fractal-type")) {
+        c.warp_fract = a.get1("warp-fractal-type", c.warp_fract);
+    }
+    if (a.has("warp-octaves")) {
+        if (!parse_i(a.get1("warp-octaves", ""), c.warp_oct) || c.warp_oct < 1) {
+            throw std::runtime_error("bad --warp-octaves");
+        }
+    }
+    if (a.has("warp-gain")) {
+        if (!parse_f(a.get1("warp-gain", ""), c.warp_gain)) {
+            throw std::runtime_error("bad --warp-gain");
+        }
+    }
+    if (a.has("warp-lacunarity")) {
+        if (!parse_f(a.get1("warp-lacunarity", ""), c.warp_lac)) {
+            throw std::runtime_error("bad --warp-lacunarity");
+        }
+    }
+    if (a.has("warp-engine")) {
+        c.warp_engine = a.get1("warp-engine", c.warp_engine);
+    }
+    if (a.has("normalize")) {
+        c.norm = a.get1("normalize", c.norm);
+    }
+    if (a.has("minmax-mode")) {
+        c.minmax_mode = a.get1("minmax-mode", c.minmax_mode);
+    }
+    if (a.has("colormap")) {
+        c.cmap = a.get1("colormap", c.cmap);
+    }
+    if (a.has("out")) {
+        c.out = a.get1("out", c.out);
+    }
+    if (a.has("format")) {
+        c.fmt = a.get1("format", c.fmt);
+    }
+    if (a.has("csv")) {
+        c.csv = a.get1("csv", c.csv);
+    }
+    if (a.has("raw")) {
+        c.raw = a.get1("raw", c.raw);
+    }
+    if (a.has("npy")) {
+        c.npy = a.get1("npy", c.npy);
+    }
+    if (a.has("dtype")) {
+        c.dtype = a.get1("dtype", c.dtype);
+    }
+    if (a.has("field")) {
+        c.field = a.get1("field", c.field);
+    }
+    if (a.has("png-level")) {
+        if (!parse_i(a.get1("png-level", ""), c.png_level) || c.png_level < 0 || c.png_level > 9) {
+            throw std::runtime_error("bad --png-level");
+        }
+    }
+    if (a.has("png-filter")) {
+        c.png_filter = a.get1("png-filter", c.png_filter);
+    }
+    if (a.has("jpeg-quality")) {
+        if (!parse_i(a.get1("jpeg-quality", ""), c.jpeg_quality) || c.jpeg_quality < 1 || c.jpeg_quality > 100) {
+            throw std::runtime_error("bad --jpeg-quality");
+        }
+    }
+    if (a.has("jpeg-subsample")) {
+        c.jpeg_sub = lo(a.get1("jpeg-subsample", ""));
+        if (c.jpeg_sub != "auto" && c.jpeg_sub != "444" && c.jpeg_sub != "422" && c.jpeg_sub != "420") {
+            throw std::runtime_error("bad --jpeg-subsample");
+        }
+    }
+    if (a.has("png-color")) {
+        c.png_color = lo(a.get1("png-color", ""));
+        if (c.png_color != "auto" && c.png_color != "rgb") {
+            throw std::runtime_error("bad --png-color");
+        }
+    }
+    c.threads = hw_threads();
+    if (a.has("threads")) {
+        if (!parse_i(a.get1("threads", ""), c.threads) || c.threads < 1) {
+            throw std::runtime_error("bad --threads");
+        }
+    }
+    if (a.has("simd")) {
+        c.simd = a.get1("simd", c.simd);
+    }
+    if (a.has("stats")) {
+        c.stats = true;
+    }
+    if (a.has("stats-json")) {
+        c.stats_json = a.get1("stats-json", c.stats_json);
+    }
+    if (a.has("trace")) {
+        c.trace = a.get1("trace", c.trace);
+    }
+    if (a.has("shard")) {
+        std::vector<std::string> p = split(a.get1("shard", ""), '/');
+        if (p.size() != 2 || !parse_i(trim(p[0]), c.shard_i) || !parse_i(trim(p[1]), c.shard_n) || c.shard_n < 1 || c.shard_i < 0 ||
+            c.shard_i >= c.shard_n || c.shard_n > c.h) {
+            throw std::runtime_error("bad --shard (want i/N with 0 <= i < N <= height)");
+        }
+    }
+    if (a.has("shard-stats")) {
+        c.shard_stats = true;
+    }
+    if (a.has("cache")) {
+        c.cache = a.get1("cache", c.cache);
+    }
+    if (a.has("cache-max")) {
+        if (!parse_i(a.get1("cache-max", ""), c.cache_max) || c.cache_max < 0) {
+            throw std::runtime_error("bad --cache-max");
+        }
+    }
+    if (a.has("pyramid")) {
+        c.pyramid = a.get1("pyramid", c.pyramid);
+    }
+    if (a.has("levels")) {
+        if (!parse_i(a.get1("levels", ""), c.levels) || c.levels < 1 || c.levels > 24) {
+            throw std::runtime_error("bad --levels");
+        }
+    }
+    if (a.has("tile-size")) {
+        if (!parse_i(a.get1("tile-size", ""), c.tile_size) || c.tile_size < 16 || c.tile_size > 4096 || c.tile_size % 2 != 0) {
+            throw std::runtime_error("bad --tile-size");
+        }
+    }
+    if (a.has("multires")) {
+        std::string v = a.get1("multires", "");
+        if (lo(v) != "off" && (!parse_i(v, c.multires) || c.multires < 4)) {
+            throw std::runtime_error("bad --multires");
+        }
+    }
+    return c;
+}
+
+// One fractal octave on its own: n is the plain noise at the octave's seed and frequency.
+// Coarse octaves (s > 0) are sampled every s world pixels on a gw x gh grid whose first
+// sample is (cx * s, cy * s), one before the image's first pixel, so every pixel has the
+// 4 x 4 Catmull-Rom neighbourhood. w holds the 4 weights of each of the s phases between
+// samples, weight k at w[k * s + phase].
+struct Octave {
+    FastNoiseLite n;
+    float amp = 0.0f;
+    int s = 0, gw = 0, gh = 0, cx = 0, cy = 0;
+    std::vector<float> g, w;
+};
+
+// Catmull-Rom weights of the samples at -1, 0, 1 and 2 for a point t in [0, 1).
+static void cr_w(float t, float* w) {
+    float t2 = t * t, t3 = t2 * t;
+    w[0] = 0.5f * (-t + 2.0f * t2 - t3);
+    w[1] = 0.5f * (2.0f - 5.0f * t2 + 3.0f * t3);
+    w[2] = 0.5f * (t + 4.0f * t2 - 3.0f * t3);
+    w[3] = 0.5f * (t3 - t2);
+}
+
+// Per-thread sampling state: noise copies, row scratch and running min/max.
+struct Worker {
+    FastNoiseLite n, wx, wy;
+    Row r;
+    std::vector<float> row, gt;
+    float mn = 0.0f, mx = 0.0f;
+    bool first = true;
+    bool hon = false;  // also count values into hs
+    Hist hs;
+
+    void see(const float* v, int cnt) {
+        if (hon) {
+            hs.add(v, cnt);
+        }
+        for (int i = 0; i < cnt; i++) {
+            if (first) {
+                mn = mx = v[i];
+                first = false;
+            } else {
+                if (v[i] < mn) {
+                    mn = v[i];
+                }
+                if (v[i] > mx) {
+                    mx = v[i];
+                }
+            }
+        }
+    }
+};
+
+// Smallest and largest value the workers have seen.
+static bool ws_range(const std::vector<Worker>& ws, float& mn, float& mx) {
+    bool first = true;
+    for (const Worker& k : ws) {
+        if (k.first) {
+            continue;
+        }
+        if (first) {
+            mn = k.mn;
+            mx = k.mx;
+            first = false;
+        } else {
+            mn = std::min(mn, k.mn);
+            mx = std::max(mx, k.mx);
+        }
+    }
+    return !first;
+}
+
+// Largest |gradient| of one octave at frequency 1, in value units per unit of distance:
+// the measured maxima plus 50%. Cellular has none (CellValue steps between cells).
+static bool grad_max(FastNoiseLite::NoiseType t, float& g) {
+    switch (t) {
+    case FastNoiseLite::NoiseType_OpenSimplex2:
+        g = 14.0f;
+        return true;
+    case FastNoiseLite::NoiseType_OpenSimplex2S:
+        g = 10.0f;
+        return true;
+    case FastNoiseLite::NoiseType_Perlin:
+        g = 5.0f;
+        return true;
+    case FastNoiseLite::NoiseType_Value:
+        g = 4.5f;
+        return true;
+    case FastNoiseLite::NoiseType_ValueCubic:
+        g = 2.5f;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Largest change of t that moves no output by more than one step: half a step of the
+// finest output. Images step once per 8-bit channel change of the colormap, which for a
+// steep ramp is much less than 1/255 in t. float32 and --field h outputs keep every octave.
+static float t_tol(const Cfg& c, const std::vector<uint32_t>& lut) {
+    const int m = 256;
+    int d = 0;
+    for (int i = 0; i + m < (int) lut.size(); i++) {
+        for (int s = 0; s < 24; s += 8) {
+            d = std::max(d, std::abs((int) ((lut[(size_t) i] >> s) & 255u) - (int) ((lut[(size_t) i + m] >> s) & 255u)));
+        }
+    }
+    float tol = d == 0 ? 1.0f : 0.5f * (float) m / ((float) d * (float) (Colormap::lut_n - 1));
+    if (!c.csv.empty()) {
+        tol = std::min(tol, 0.5e-6f);
+    }
+    if (!c.raw.empty() || !c.npy.empty()) {
+        bool u16 = lo(c.dtype) == "uint16" && lo(c.field) == "t";
+        tol = std::min(tol, u16 ? 0.5f / 65535.0f : 0.0f);
+    }
+    return tol;
+}
+
+// Drops the top octaves of the main fractal and of a fractal warp while the sum of their
+// amplitudes stays within ev, so no sample moves by more than ev (returned in dv).
+// Fractal octave i is at most bound * (gain * max(1, |1 - wstr|))^i with peak noise 1. A
+// warp octave moves the main noise by at most its displacement (up to sqrt(2) * amp) times
+// the Lipschitz bound of the octaves kept; weighted octaves have none, so they keep the warp.
+static void octave_cut(const Cfg& c, const FastNoiseLite& n, const FastNoiseLite& wx, Warp wm, bool fused, float ev, int& oct,
+                       int& woct, float& dv) {
+    oct = c.oct;
+    woct = c.warp_oct;
+    dv = 0.0f;
+    float g;
+    if (!grad_max(nt(c.type), g)) {
+        return;
+    }
+    FastNoiseLite::FractalType f = ft(c.fract);
+    bool wf = wm == Warp::Progressive || wm == Warp::Independent;
+    float gain = std::fabs(c.gain) * std::max(1.0f, std::fabs(1.0f - c.wstr));
+    std::vector<float> a((size_t) c.oct, 1.0f);
+    for (int i = 0; i < c.oct; i++) {
+        a[(size_t) i] = fractal_bounding(n) * std::pow(gain, (float) i);
+    }
+    if (f != FastNoiseLite::FractalType_None) {
+        float share = wf && c.warp_oct > 1 ? ev * 0.5f : ev;
+        while (oct > 1 && dv + a[(size_t) oct - 1] <= share) {
+            dv += a[(size_t) --oct];
+        }
+    }
+    if (!wf || c.wstr != 0.0f) {
+        return;
+    }
+    float k = f == FastNoiseLite::FractalType_Ridged ? 2.0f : f == FastNoiseLite::FractalType_PingPong ? 2.0f * std::fabs(c.pp) : 1.0f;
+    float lip = g * c.freq;
+    if (f != FastNoiseLite::FractalType_None) {
+        lip = 0.0f;
+        for (int i = 0; i < oct; i++) {
+            lip += a[(size_t) i] * k * g * c.freq * std::pow(std::fabs(c.lac), (float) i);
+        }
+    }
+    float w0 = std::fabs(c.warp_amp) * (fused ? fractal_bounding(wx) : 1.0f) * 1.41421356f;
+    float wt = 0.0f;
+    while (woct > 1) {
+        float t = wt + w0 * std::pow(std::fabs(c.warp_gain), (float) (woct - 1));
+        if (dv + lip * t > ev) {
+            break;
+        }
+        wt = t;
+        woct--;
+    }
+    dv += lip * wt;
+}
+
+// Largest error of bicubic upsampling one octave (peak 1) sampled N times per lattice period
+// is about mr_k / N^2: the measured maxima for N >= 4 plus 50%.
+static float mr_k(FastNoiseLite::NoiseType t) {
+    switch (t) {
+    case FastNoiseLite::NoiseType_OpenSimplex2:
+        return 7.5f;
+    case FastNoiseLite::NoiseType_OpenSimplex2S:
+        return 4.0f;
+    case FastNoiseLite::NoiseType_Perlin:
+        return 1.25f;
+    case FastNoiseLite::NoiseType_ValueCubic:
+        return 0.3f;
+    default:
+        return 1.25f;
+    }
+}
+
+// Splits an FBm (or single octave) stack into octaves with at least 2 * N pixels per lattice
+// period, which go on grids of spacing floor(period / N), and octaves sampled per pixel.
+// Returns the bound on the change of any value, or -1 when the settings don't allow it:
+// warped and tiled coordinates are not a grid, Cellular has steps and weighted or
+// non-FBm octaves don't add up linearly.
+static float mr_plan(const Cfg& c, int oct, const FastNoiseLite& n, std::vector<Octave>& os) {
+    os.clear();
+    FastNoiseLite::FractalType f = ft(c.fract);
+    FastNoiseLite::NoiseType t = nt(c.type);
+    if (c.warp || c.tile || t == FastNoiseLite::NoiseType_Cellular ||
+        (f != FastNoiseLite::FractalType_None && (f != FastNoiseLite::FractalType_FBm || c.wstr != 0.0f))) {
+        return -1.0f;
+    }
+    if (f == FastNoiseLite::FractalType_None) {
+        oct = 1;
+    }
+    float amp = f == FastNoiseLite::FractalType_None ? 1.0f : fractal_bounding(n);
+    float freq = c.freq;
+    float e = 0.0f;
+    for (int i = 0; i < oct; i++) {
+        Octave o;
+        o.n = n;
+        o.n.SetFractalType(FastNoiseLite::FractalType_None);
+        o.n.SetSeed(c.seed + i);
+        o.n.SetFrequency(freq);
+        o.amp = amp;
+        float per = 1.0f / std::fabs(freq);
+        int sp = (int) std::min(per / (float) c.multires, 65536.0f);
+        if (sp >= 2) {
+            o.s = sp;
+            o.w.resize((size_t) sp * 4u);
+            for (int p = 0; p < sp; p++) {
+                float w[4];
+                cr_w((float) p / (float) sp, w);
+                for (int k = 0; k < 4; k++) {
+                    o.w[(size_t) (k * sp + p)] = w[k];
+                }
+            }
+            e += std::fabs(amp) * mr_k(t) * (float) sp * (float) sp / (per * per);
+        }
+        os.push_back(std::move(o));
+        amp *= c.gain;
+        freq *= c.lac;
+    }
+    return e;
+}
+
+// Row y of the octave sum: coarse octaves upsampled from their grids, the rest sampled.
+static void mr_row(const std::vector<Octave>& os, Row& r, std::vector<float>& gt, bool use3, int y, float* out) {
+    std::fill(out, out + r.w, 0.0f);
+    for (int x = 0; x < r.w; x++) {
+        r.x[x] = (float) (r.x0 + x);
+        r.y[x] = (float) y;
+    }
+    for (const Octave& o : os) {
+        if (o.s > 0) {
+            // Columns first (amplitude folded in), then each cell's s pixels from its 4 columns.
+            int j = fdiv(y, o.s);
+            const float* wy = o.w.data() + (y - j * o.s);
+            j -= o.cy + 1;
+            float w0 = wy[0] * o.amp, w1 = wy[o.s] * o.amp, w2 = wy[2 * o.s] * o.amp, w3 = wy[3 * o.s] * o.amp;
+            size_t gw = (size_t) o.gw;
+            const float* g = o.g.data() + (size_t) j * gw;
+            gt.resize(gw);
+            float* t = gt.data();
+            for (size_t i = 0; i < gw; i++) {
+                t[i] = g[i] * w0 + g[gw + i] * w1 + g[2 * gw + i] * w2 + g[3 * gw + i] * w3;
+            }
+            const float* x0 = o.w.data();
+            const float* x1 = x0 + o.s;
+            const float* x2 = x1 + o.s;
+            const float* x3 = x2 + o.s;
+            int i = fdiv(r.x0, o.s), f = r.x0 - i * o.s;
+            i -= o.cx + 1;
+            for (int x = 0; x < r.w; i++, f = 0) {
+                float a = t[i], b = t[i + 1], c = t[i + 2], d = t[i + 3];
+                float* v = out + x;
+                int e = std::min(o.s - f, r.w - x);
+                for (int p = 0; p < e; p++) {
+                    v[p] += x0[f + p] * a + x1[f + p] * b + x2[f + p] * c + x3[f + p] * d;
+                }
+                x += e;
+            }
+            continue;
+        }
+        if (use3) {
+            noise_row(o.n, r.x.data(), r.y.data(), r.z.data(), r.a.data(), r.w, r.isa);
+        } else {
+            noise_row(o.n, r.x.data(), r.y.data(), r.a.data(), r.w, r.isa);
+        }
+        for (int x = 0; x < r.w; x++) {
+            out[x] += r.a[x] * o.amp;
+        }
+    }
+}
+
+// Prints (--stats) and writes (--stats-json, --trace) what the trace recorded. `e` is the
+// noise evaluations per sampled pixel; probe and multires grid samples are counted at theirs.
+static void stats_out(const Cfg& c, const Trace& tr, double e, int tn, Isa isa) {
+    double wall = tr.now();
+    double px = (double) c.w * (double) c.h;
+    std::vector<Trace::Stage> st = tr.stages();
+    double evals = 0.0;
+    for (const Trace::Stage& s : st) {
+        if (s.name == "sample" || s.name == "probe") {
+            evals += s.px * e;
+        } else if (s.name == "multires grid") {
+            evals += s.px;
+        }
+    }
+    double rss = peak_rss_mb();
+    if (c.stats) {
+        std::fprintf(stderr, "stats: %dx%d (%.2f Mpixel), %.2f noise evaluations/pixel, %d thread%s, %s\n", c.w, c.h, px * 1e-6,
+                     evals / px, tn, tn == 1 ? "" : "s", isa_name(isa));
+        std::fprintf(stderr, "  %-16s %10s %10s %10s\n", "stage", "wall ms", "busy ms", "Mpixel/s");
+        for (const Trace::Stage& s : st) {
+            if (s.px > 0.0 && s.busy > 0.0) {
+                std::fprintf(stderr, "  %-16s %10.2f %10.2f %10.2f\n", s.name.c_str(), s.wall * 1e3, s.busy * 1e3, s.px / s.busy * 1e-6);
+            } else {
+                std::fprintf(stderr, "  %-16s %10.2f %10.2f\n", s.name.c_str(), s.wall * 1e3, s.busy * 1e3);
+            }
+        }
+        std::fprintf(stderr, "  %-16s %10.2f %10s %10.2f\n", "total", wall * 1e3, "", px / wall * 1e-6);
+        std::fprintf(stderr, "  peak RSS %.1f MiB\n", rss);
+    }
+    if (!c.stats_json.empty()) {
+        char b[512];
+        std::snprintf(b, sizeof b,
+                      "{\"width\":%d,\"height\":%d,\"threads\":%d,\"simd\":\"%s\",\"wall_ms\":%.3f,\"mpix_s\":%.3f,"
+                      "\"evals_per_pixel\":%.4f,\"peak_rss_mb\":%.2f,\"stages\":[",
+                      c.w, c.h, tn, isa_name(isa), wall * 1e3, px / wall * 1e-6, evals / px, rss);
+        std::string s = b;
+        for (size_t i = 0; i < st.size(); i++) {
+            const Trace::Stage& g = st[i];
+            std::snprintf(b, sizeof b, "%s{\"name\":\"%s\",\"wall_ms\":%.3f,\"busy_ms\":%.3f,\"pixels\":%.0f,\"mpix_s\":%.3f,\"spans\":%d}",
+                          i ? "," : "", g.name.c_str(), g.wall * 1e3, g.busy * 1e3, g.px, g.busy > 0.0 ? g.px / g.busy * 1e-6 : 0.0, g.n);
+            s += b;
+        }
+        write_all(c.stats_json, s + "]}\n");
+    }
+    if (!c.trace.empty()) {
+        tr.write_chrome(c.trace);
+    }
+}
+
+static const int band = 16;
+
+// Everything a render needs once the settings are validated: the noise instances, one
+// worker per thread, the octaves --octave-cutoff keeps (rc) and the --multires grids. nm
+// and lp (the colormap, equalization baked in) are valid after finish_norm().
+struct RenderState {
+    Cfg c, rc;
+    FastNoiseLite n, wx, wy;
+    Warp wm = Warp::Off;
+    bool fused = false, use3 = false, ranged = false, hist = false, cut = false;
+    float ev = 0.0f;  // --octave-cutoff's error budget; cached with the samples
+    Isa isa = Isa::Scalar;
+    RowFn row_of = nullptr;
+    std::string norm, mm;
+    float plo = 0.0f, phi = 0.0f;
+    std::shared_ptr<const std::vector<uint32_t>> lut;
+    std::vector<uint32_t> eql;
+    const uint32_t* lp = nullptr;
+    int sw = 0, sh = 0, tn = 1;
+    int sh_all = 0;  // rows of the whole image's block, for shards
+    std::vector<Worker> ws;
+    std::vector<Octave> os;
+    Norm nm;
+    std::string report;
+    Trace off;
+    Trace& tr;
+
+    RenderState(const Cfg& c0, std::shared_ptr<const std::vector<uint32_t>> lut0, Trace* t, int tn0);
+
+    // Image row y, columns [x0, x0 + w), into out; sampled at the world pixels c.ox/c.oy on.
+    void row(Worker& k, int x0, int w, int y, float* out) {
+        k.r.span(c.ox + x0, w);
+        if (os.empty()) {
+            row_of(k.n, k.wx, k.wy, k.r, rc, c.oy + y, out);
+        } else {
+            mr_row(os, k.r, k.gt, use3, c.oy + y, out);
+        }
+    }
+
+    // Band b of the sw x sh block, which every pass of a file render walks.
+    void sample_band(int b, int tid, float* out) {
+        Worker& k = ws[(size_t) tid];
+        int y0 = b * band;
+        int y1 = std::min(sh, y0 + band);
+        Scope sp(tr, "sample", tid, (double) (y1 - y0) * sw);
+        for (int y = y0; y < y1; y++) {
+            float* v = out + (size_t) (y - y0) * (size_t) sw;
+            row(k, 0, sw, y, v);
+            k.see(v, sw);
+        }
+    }
+
+    // --octave-cutoff and --multires, before any row(). Both sample noise first (the probe
+    // and the grids) unless `sample` is false, as on a --cache hit: the cutoff then takes
+    // its budget from ev, and multires plans and reports without building grids.
+    void prepare(bool sample = true);
+    void cutoff(bool probe);
+    void multires(bool grids);
+    // Sets nm (and lp) from what the workers saw; every mode but fixed needs a full pass.
+    void finish_norm();
+};
+
+RenderState::RenderState(const Cfg& c0, std::shared_ptr<const std::vector<uint32_t>> lut0, Trace* t, int tn0)
+    : c(c0), lut(std::move(lut0)), tn(tn0), tr(t ? *t : off) {
+    if (c.warp_freq <= 0.0f) {
+        c.warp_freq = c.freq;
+    }
+    if (c.warp_rot3.empty()) {
+        c.warp_rot3 = c.rot3;
+    }
+    if (c.tile_p <= 0) {
+        c.tile_p = c.w;
+    }
+    if (c.w <= 0 || c.h <= 0) {
+        throw std::runtime_error("bad --width/--height");
+    }
+    n.SetSeed(c.seed);
+    n.SetNoiseType(nt(c.type));
+    n.SetRotationType3D(rt3(c.rot3));
+    n.SetFrequency(c.freq);
+    n.SetFractalType(ft(c.fract));
+    n.SetFractalOctaves(c.oct);
+    n.SetFractalGain(c.gain);
+    n.SetFractalLacunarity(c.lac);
+    n.SetFractalWeightedStrength(c.wstr);
+    n.SetFractalPingPongStrength(c.pp);
+    if (lo(c.type) == "cellular") {
+        n.SetCellularDistanceFunction(cdf(c.cell_dist));
+        n.SetCellularReturnType(crt(c.cell_ret));
+        n.SetCellularJitter(c.cell_j);
+    }
+    std::string we = lo(c.warp_engine);
+    if (we != "fused" && we != "legacy") {
+        throw std::runtime_error("bad --warp-engine: " + c.warp_engine);
+    }
+    wm = warp_mode(c);
+    fused = c.warp && we == "fused";
+    if (fused) {
+        wx.SetSeed(c.warp_seed);
+        wx.SetFrequency(c.warp_freq);
+        wx.SetDomainWarpType(dwt(c.warp_type));
+        wx.SetDomainWarpAmp(c.warp_amp);
+        wx.SetFractalType(wm == Warp::Progressive ? FastNoiseLite::FractalType_DomainWarpProgressive
+                          : wm == Warp::Independent ? FastNoiseLite::FractalType_DomainWarpIndependent
+                                                    : FastNoiseLite::FractalType_None);
+        wx.SetFractalOctaves(wm == Warp::Single ? 1 : c.warp_oct);
+        wx.SetFractalGain(c.warp_gain);
+        wx.SetFractalLacunarity(c.warp_lac);
+    } else if (c.warp) {
+        std::string t = warp_nt(c.warp_type);
+        wx.SetSeed(c.warp_seed);
+        wy.SetSeed(c.warp_seed + 1);
+        wx.SetNoiseType(nt(t));
+        wy.SetNoiseType(nt(t));
+        wx.SetRotationType3D(rt3(c.warp_rot3));
+        wy.SetRotationType3D(rt3(c.warp_rot3));
+        wx.SetFrequency(c.warp_freq);
+        wy.SetFrequency(c.warp_freq);
+    }
+    use3 = c.z != 0.0f;
+    isa = isa_parse(c.simd);
+    row_of = row_fn(tiling(c), wm, fused, use3);
+    norm = lo(c.norm);
+    if (st(norm, "percentile:")) {
+        std::vector<std::string> p = split(norm.substr(11), ',');
+        if (p.size() != 2 || !parse_f(trim(p[0]), plo) || !parse_f(trim(p[1]), phi) || !(0.0f <= plo && plo < phi && phi <= 100.0f)) {
+            throw std::runtime_error("bad --normalize: " + c.norm);
+        }
+        norm = "percentile";
+    } else if (norm != "fixed" && norm != "minmax" && norm != "equalize") {
+        throw std::runtime_error("bad --normalize: " + c.norm);
+    }
+    // percentile and equalize come from histograms the workers fill while sampling.
+    hist = norm == "percentile" || norm == "equalize";
+    ranged = norm != "fixed";
+    mm = lo(c.minmax_mode);
+    if (mm != "auto" && mm != "buffer" && mm != "prepass") {
+        throw std::runtime_error("bad --minmax-mode: " + c.minmax_mode);
+    }
+    std::string oc = lo(c.oct_cut);
+    if (oc != "off" && oc != "auto") {
+        throw std::runtime_error("bad --octave-cutoff: " + c.oct_cut);
+    }
+    cut = oc == "auto";
+    lp = lut->data();
+    // A tiled image larger than its period repeats the top-left sw x sh block exactly, so
+    // a file render samples and colorizes only that block and copies the rest.
+    sw = c.w;
+    sh = c.h;
+    if (c.tile) {
+        sw = std::min(c.tile_p, c.w);
+        sh = std::min(c.tile_p, c.h);
+    }
+    ws.resize((size_t) tn);
+    for (Worker& k : ws) {
+        k.n = n;
+        k.wx = wx;
+        k.wy = wy;
+        k.r.init(c.w, c.z, isa);
+        k.row.resize((size_t) c.w);
+        k.first = true;
+        // The cutoff probe only runs without a histogram (its budget is 0 then).
+        k.hon = hist;
+        if (hist) {
+            k.hs.clear();
+        }
+    }
+    rc = c;
+    if (tr.on) {
+        tr.add("setup", 0, 0.0, 0.0);
+    }
+}
+
+void RenderState::prepare(bool sample) {
+    if (cut) {
+        cutoff(sample);
+    }
+    if (c.multires > 0) {
+        multires(sample);
+    }
+}
+
+void RenderState::cutoff(bool probe) {
+    // fixed maps v to v / 2 + 0.5. minmax divides by the range, which every 16th row
+    // at full octaves bounds from below; the shifted min and max at most double the
+    // change, hence the 4. Percentiles and equalization have no such bound.
+    float tol = hist ? 0.0f : t_tol(c, *lut);
+    if (probe) {
+        ev = 2.0f * tol;
+    }
+    if (probe && ranged && tol > 0.0f) {
+        par_for((sh + band - 1) / band, tn, [&](int i, int tid) {
+            Scope sp(tr, "probe", tid, (double) sw);
+            Worker& k = ws[(size_t) tid];
+            row(k, 0, sw, i * band, k.row.data());
+            k.see(k.row.data(), sw);
+        });
+        float mn = 0.0f, mx = 0.0f;
+        ws_range(ws, mn, mx);
+        ev = (mx - mn) * tol * 0.25f;
+        for (Worker& k : ws) {
+            k.first = true;
+        }
+    }
+    float dv;
+    octave_cut(c, n, wx, wm, fused, ev, rc.oct, rc.warp_oct, dv);
+    for (Worker& k : ws) {
+        keep_octaves(k.n, rc.oct);
+    }
+    char b[256];
+    std::snprintf(b, sizeof b, "octave-cutoff: octaves %d -> %d", c.oct, rc.oct);
+    report += b;
+    if (wm == Warp::Progressive || wm == Warp::Independent) {
+        std::snprintf(b, sizeof b, ", warp octaves %d -> %d", c.warp_oct, rc.warp_oct);
+        report += b;
+    }
+    float g;
+    if (!grad_max(nt(c.type), g)) {
+        report += " (Cellular: no bound, nothing dropped)\n";
+    } else {
+        std::snprintf(b, sizeof b, " (samples move by <= %.3g, budget %.3g)\n", dv, ev);
+        report += b;
+    }
+}
+
+void RenderState::multires(bool grids) {
+    float e = mr_plan(c, rc.oct, n, os);
+    if (e < 0.0f) {
+        report += "multires: off (needs unwarped, untiled FBm or None fractal, --weighted-strength 0, not Cellular)\n";
+        return;
+    }
+    std::vector<std::pair<int, int>> gr;
+    double full = (double) os.size() * (double) sw * (double) sh, cnt = 0.0;
+    int nc = 0;
+    size_t gmax = 0;
+    for (int i = 0; i < (int) os.size(); i++) {
+        Octave& o = os[(size_t) i];
+        if (o.s == 0) {
+            cnt += (double) sw * (double) sh;
+            continue;
+        }
+        o.cx = fdiv(c.ox, o.s) - 1;
+        o.cy = fdiv(c.oy, o.s) - 1;
+        o.gw = fdiv(c.ox + sw - 1, o.s) - o.cx + 3;
+        o.gh = fdiv(c.oy + sh - 1, o.s) - o.cy + 3;
+        if (grids) {
+            o.g.resize((size_t) o.gw * (size_t) o.gh);
+            for (int j = 0; j < o.gh; j++) {
+                gr.emplace_back(i, j);
+            }
+        }
+        cnt += (double) o.gw * (double) o.gh;
+        gmax = std::max(gmax, (size_t) o.gw);
+        nc++;
+    }
+    par_for((int) gr.size(), tn, [&](int i, int tid) {
+        Octave& o = os[(size_t) gr[(size_t) i].first];
+        Scope sp(tr, "multires grid", tid, (double) o.gw);
+        int j = gr[(size_t) i].second;
+        std::vector<float> gx((size_t) o.gw), gy((size_t) o.gw, (float) ((o.cy + j) * o.s)), gz((size_t) o.gw, c.z);
+        for (int k = 0; k < o.gw; k++) {
+            gx[(size_t) k] = (float) ((o.cx + k) * o.s);
+        }
+        float* g = o.g.data() + (size_t) j * (size_t) o.gw;
+        if (use3) {
+            noise_row(o.n, gx.data(), gy.data(), gz.data(), g, o.gw, isa);
+        } else {
+            noise_row(o.n, gx.data(), gy.data(), g, o.gw, isa);
+        }
+    });
+    for (Worker& k : ws) {
+        k.gt.reserve(grids ? gmax : 0);
+    }
+    char b[256];
+    std::snprintf(b, sizeof b, "multires: %d of %d octaves upsampled, %.1fx fewer samples (samples move by <= %.3g)\n", nc,
+                  (int) os.size(), full / cnt, e);
+    report += b;
+}
+
+void RenderState::finish_norm() {
+    nm = Norm::fixed();
+    lp = lut->data();
+    if (ranged) {
+        float mn = 0.0f, mx = 0.0f;
+        ws_range(ws, mn, mx);
+        nm = Norm::minmax(mn, mx);
+    }
+    if (!hist) {
+        return;
+    }
+    Scope sp(tr, "histogram", 0);
+    Hist& hs = ws[0].hs;
+    for (size_t i = 1; i < ws.size(); i++) {
+        hs.merge(ws[i].hs);
+    }
+    hs.done();
+    for (Worker& k : ws) {
+        k.hon = false;
+    }
+    if (norm == "percentile") {
+        float a = clampv(hs.quantile(plo / 100.0), nm.s, nm.s + nm.q);
+        float b = clampv(hs.quantile(phi / 100.0), nm.s, nm.s + nm.q);
+        nm = Norm::minmax(a, std::max(a, b));
+    } else {
+        // The CDF sampled at lut_n points over [min, max]; colorize gets it baked into
+        // the colormap, the field writers look it up.
+        auto eq = std::make_shared<std::vector<float>>((size_t) Colormap::lut_n);
+        for (int i = 0; i < Colormap::lut_n; i++) {
+            (*eq)[(size_t) i] = hs.cdf(nm.s + nm.q * (float) i / (float) (Colormap::lut_n - 1));
+        }
+        nm.eq = eq;
+        eql = nm.bake(*lut);
+        lp = eql.data();
+    }
+}
+
+Renderer::Renderer(const Cfg& c) {
+    auto lut = std::make_shared<const std::vector<uint32_t>>(Colormap::parse(c.cmap).bake());
+    s = std::make_unique<RenderState>(c, lut, nullptr, std::max(1, c.threads));
+    RenderState& m = *s;
+    m.prepare();
+    if (m.ranged) {
+        par_for(m.sh, m.tn, [&](int y, int tid) {
+            Worker& k = m.ws[(size_t) tid];
+            m.row(k, 0, m.sw, y, k.row.data());
+            k.see(k.row.data(), m.sw);
+        });
+    }
+    m.finish_norm();
+}
+
+Renderer::~Renderer() = default;
+Renderer::Renderer(Renderer&&) noexcept = default;
+Renderer& Renderer::operator=(Renderer&&) noexcept = default;
+
+int Renderer::width() const {
+    return s->c.w;
+}
+
+int Renderer::height() const {
+    return s->c.h;
+}
+
+const std::string& Renderer::report() const {
+    return s->report;
+}
+
+static void check_rect(const Cfg& c, int x, int y, int w, int h) {
+    if (x < 0 || y < 0 || w < 1 || h < 1 || x > c.w - w || y > c.h - h) {
+        throw std::runtime_error("rectangle outside the image");
+    }
+}
+
+void Renderer::field(int x, int y, int w, int h, float* out, size_t stride) {
+    check_rect(s->c, x, y, w, h);
+    RenderState& m = *s;
+    auto f = [&](int j, int tid) { m.row(m.ws[(size_t) tid], x, w, y + j, out + (size_t) j * stride); };
+    if (m.tn == 1) {
+        // Not through par_for, whose std::function may allocate.
+        for (int j = 0; j < h; j++) {
+            f(j, 0);
+        }
+        return;
+    }
+    par_for(h, m.tn, f);
+}
+
+void Renderer::rgb(int x, int y, int w, int h, uint8_t* out, size_t stride) {
+    check_rect(s->c, x, y, w, h);
+    RenderState& m = *s;
+    auto f = [&](int j, int tid) {
+        Worker& k = m.ws[(size_t) tid];
+        m.row(k, x, w, y + j, k.row.data());
+        colorize(k.row.data(), w, m.nm, m.lp, out + (size_t) j * stride, m.isa);
+    };
+    if (m.tn == 1) {
+        for (int j = 0; j < h; j++) {
+            f(j, 0);
+        }
+        return;
+    }
+    par_for(h, m.tn, f);
+}
+
+// --shard-stats output of shard i: the range of its values and, for percentile and
+// equalize, the nonzero histogram bins. The first line names the settings it belongs to.
+static std::string side_path(const Cfg& c, int i) {
+    return c.out + "." + std::to_string(i) + "-of-" + std::to_string(c.shard_n) + ".stats";
+}
+
+static std::string side_key(const Cfg& c) {
+    return "noise-shard 1 " + std::to_string(c.w) + "x" + std::to_string(c.h) + " " + std::to_string(c.ox) + "," + std::to_string(c.oy) + " " +
+           std::to_string(c.shard_n) + " " + lo(c.norm);
+}
+
+// Samples the rows of shard c0 that the whole image's normalization pass would see (with
+// tiling only the first period is counted) and writes its sidecar.
+static void shard_stats(const Cfg& c0, int y0, RenderState& m) {
+    int rows = std::max(0, std::min(m.c.h, m.sh_all - y0));
+    par_for(rows, m.tn, [&](int y, int tid) {
+        Scope sp(m.tr, "sample", tid, (double) m.sw);
+        Worker& k = m.ws[(size_t) tid];
+        m.row(k, 0, m.sw, y, k.row.data());
+        k.see(k.row.data(), m.sw);
+    });
+    float mn = 0.0f, mx = 0.0f;
+    bool seen = ws_range(m.ws, mn, mx);
+    char b[96];
+    std::snprintf(b, sizeof b, "%d %.9g %.9g\n", seen ? 1 : 0, mn, mx);
+    std::string s = side_key(c0) + "\n" + b;
+    if (m.hist) {
+        Hist& hs = m.ws[0].hs;
+        for (size_t i = 1; i < m.ws.size(); i++) {
+            hs.merge(m.ws[i].hs);
+        }
+        for (size_t i = 0; i < hs.n.size(); i++) {
+            if (hs.n[i]) {
+                s += std::to_string(i) + " " + std::to_string(hs.n[i]) + "\n";
+            }
+        }
+    }
+    write_all(side_path(c0, c0.shard_i), s);
+}
+
+// Merges the sidecars of all shards into worker 0, so finish_norm() sees the whole image.
+static void shard_merge(const Cfg& c0, RenderState& m) {
+    Worker& w0 = m.ws[0];
+    std::string key = side_key(c0);
+    for (int i = 0; i < c0.shard_n; i++) {
+        std::string p = side_path(c0, i);
+        std::vector<std::string> ls;
+        try {
+            ls = split(read_all(p), '\n');
+        } catch (const std::exception&) {
+            throw std::runtime_error("missing " + p + ": run every shard with --shard-stats first");
+        }
+        if (ls.size() < 2 || ls[0] != key) {
+            throw std::runtime_error(p + " is from other settings (want \"" + key + "\")");
+        }
+        std::vector<std::string> v = split(ls[1], ' ');
+        float mn, mx;
+        if (v.size() != 3 || !parse_f(v[1], mn) || !parse_f(v[2], mx)) {
+            throw std::runtime_error("bad " + p);
+        }
+        if (v[0] == "1") {
+            if (w0.first) {
+                w0.mn = mn;
+                w0.mx = mx;
+                w0.first = false;
+            } else {
+                w0.mn = std::min(w0.mn, mn);
+                w0.mx = std::max(w0.mx, mx);
+            }
+        }
+        for (size_t j = 2; m.hist && j < ls.size(); j++) {
+            std::vector<std::string> e = split(ls[j], ' ');
+            int bin;
+            uint64_t cnt;
+            if (e.empty() || trim(ls[j]).empty()) {
+                continue;
+            }
+            if (e.size() != 2 || !parse_i(e[0], bin) || bin < 0 || bin >= (int) w0.hs.n.size() || !parse_u64(e[1], cnt)) {
+                throw std::runtime_error("bad " + p);
+            }
+            uint64_t& b = w0.hs.n[(size_t) bin];
+            if (cnt > UINT64_MAX - b) {
+                throw std::runtime_error("bad " + p + ": histogram bin overflows");
+            }
+            b += cnt;
+        }
+    }
+    m.finish_norm();
+}
+
+// Everything the sampled block depends on, canonically, from the settings alone so that a
+// hit needs no sampling: with --octave-cutoff auto that includes what the probe's decision
+// depends on, and settings that do not apply are left out.
+static std::string noise_key(const RenderState& m) {
+    const Cfg& c = m.c;
+    std::string k;
+    char b[64];
+    auto i = [&](const char* n, int v) { k += std::string(n) + "=" + std::to_string(v) + ";"; };
+    auto f = [&](const char* n, float v) {
+        std::snprintf(b, sizeof b, "%.9g", v);
+        k += std::string(n) + "=" + b + ";";
+    };
+    auto s = [&](const char* n, const std::string& v) { k += std::string(n) + "=" + lo(v) + ";"; };
+    i("w", m.sw);
+    i("h", m.sh);
+    i("ox", c.ox);
+    i("oy", c.oy);
+    i("seed", c.seed);
+    f("freq", c.freq);
+    f("z", c.z);
+    s("type", c.type);
+    s("rot3", c.rot3);
+    if (c.tile) {
+        i("tile", c.tile_p);
+        s("tile_mode", c.tile_mode);
+    }
+    s("fract", c.fract);
+    i("oct", c.oct);
+    f("gain", c.gain);
+    f("lac", c.lac);
+    f("wstr", c.wstr);
+    f("pp", c.pp);
+    if (lo(c.type) == "cellular") {
+        s("cell_dist", c.cell_dist);
+        s("cell_ret", c.cell_ret);
+        f("cell_j", c.cell_j);
+    }
+    if (c.warp) {
+        s("warp_type", c.warp_type);
+        f("warp_amp", c.warp_amp);
+        i("warp_seed", c.warp_seed);
+        f("warp_freq", c.warp_freq);
+        s("warp_rot3", c.warp_rot3);
+        s("warp_fract", c.warp_fract);
+        i("warp_oct", c.warp_oct);
+        f("warp_gain", c.warp_gain);
+        f("warp_lac", c.warp_lac);
+        s("warp_engine", c.warp_engine);
+    }
+    if (m.cut) {
+        s("cut_norm", m.hist ? "hist" : m.ranged ? "range" : "fixed");
+        f("cut_tol", m.hist ? 0.0f : t_tol(c, *m.lut));
+    }
+    i("multires", c.multires);
+    return k;
+}
+
+// Noise evaluations per sampled pixel, at the octaves kept.
+static double evals(const RenderState& m) {
+    const Cfg& c = m.c;
+    Tiling tl = tiling(c);
+    double tf = tl == Tiling::Blend ? 4.0 : 1.0;
+    double main = ft(c.fract) == FastNoiseLite::FractalType_None ? 1.0 : (double) m.rc.oct;
+    if (!m.os.empty()) {
+        main = 0.0;
+        for (const Octave& o : m.os) {
+            main += o.s == 0 ? 1.0 : 0.0;
+        }
+    }
+    double e = main * tf;
+    if (m.wm != Warp::Off) {
+        double wo = m.wm == Warp::Single ? 1.0 : (double) m.rc.warp_oct;
+        e += wo * (m.fused ? (tl == Tiling::Off ? 1.0 : 4.0) : 2.0 * tf);
+    }
+    return e;
+}
+
+// --pyramid: level z of L is the image scaled down by 2^(L - 1 - z), cut into T x T tiles
+// written as <dir>/z/x/y.png (zero-padded past the image's edge). Only the finest level
+// is sampled; every coarser tile is the 2 x 2 box average of its four children. Workers
+// each take whole subtrees and walk them depth first, so a worker holds one tile per
+// level below its root and the roots' level is the only one kept entire.
+struct Pyramid {
+    RenderState& m;
+    Trace& tr;
+    std::string dir;
+    int L, T;
+    std::vector<int> W, H;
+    OutOpt oo;
+
+    int nx(int z) const { return (W[(size_t) z] + T - 1) / T; }
+    int ny(int z) const { return (H[(size_t) z] + T - 1) / T; }
+
+    void write(int z, int tx, int ty, const uint8_t* t, int tid) {
+        Scope sp(tr, "write png", tid, (double) T * T);
+        std::string p = dir + "/" + std::to_string(z) + "/" + std::to_string(tx) + "/" + std::to_string(ty) + ".png";
+        std::unique_ptr<ImageOut> o = ImageOut::open(p, "png", T, T, oo);
+        o->rows(t, T);
+        o->finish();
+    }
+
+    // Quadrant (dx, dy) of tile (tx, ty) at level z from child tile ch at level z + 1,
+    // averaging only the child pixels inside the image.
+    void down(int z, int tx, int ty, int dx, int dy, const uint8_t* ch, uint8_t* t) const {
+        int cw = W[(size_t) z + 1], chh = H[(size_t) z + 1];
+        int q = T / 2;
+        for (int j = 0; j < q; j++) {
+            int py = dy * q + j;
+            int cy = (2 * ty + dy) * T + 2 * j;
+            if (ty * T + py >= H[(size_t) z]) {
+                break;
+            }
+            int ny2 = cy + 1 < chh ? 2 : 1;
+            for (int i = 0; i < q; i++) {
+                int px = dx * q + i;
+                int cx = (2 * tx + dx) * T + 2 * i;
+                if (tx * T + px >= W[(size_t) z]) {
+                    break;
+                }
+                int nx2 = cx + 1 < cw ? 2 : 1;
+                int n = nx2 * ny2;
+                uint8_t* d = t + ((size_t) py * T + px) * 3;
+                for (int k = 0; k < 3; k++) {
+                    int s = 0;
+                    for (int b = 0; b < ny2; b++) {
+                        const uint8_t* r = ch + ((size_t) (2 * j + b) * T + 2 * i) * 3 + k;
+                        s += r[0] + (nx2 > 1 ? r[3] : 0);
+                    }
+                    d[k] = (uint8_t) ((s + n / 2) / n);
+                }
+            }
+        }
+    }
+
+    // Tile (tx, ty) at level z into t (T x T, zeroed), writing it and its whole subtree.
+    void build(int z, int tx, int ty, int tid, uint8_t* t) {
+        if (z == L - 1) {
+            Worker& k = m.ws[(size_t) tid];
+            int tw = std::min(T, W[(size_t) z] - tx * T);
+            int th = std::min(T, H[(size_t) z] - ty * T);
+            Scope sp(tr, "sample", tid, (double) tw * th);
+            for (int r = 0; r < th; r++) {
+                m.row(k, tx * T, tw, ty * T + r, k.row.data());
+                colorize(k.row.data(), tw, m.nm, m.lp, t + (size_t) r * T * 3, m.isa);
+            }
+        } else {
+            std::vector<uint8_t> ch((size_t) T * T * 3);
+            for (int d = 0; d < 4; d++) {
+                int cx = 2 * tx + (d & 1), cy = 2 * ty + (d >> 1);
+                if (cx >= nx(z + 1) || cy >= ny(z + 1)) {
+                    continue;
+                }
+                std::fill(ch.begin(), ch.end(), (uint8_t) 0);
+                build(z + 1, cx, cy, tid, ch.data());
+                Scope sp(tr, "downsample", tid);
+                down(z, tx, ty, d & 1, d >> 1, ch.data(), t);
+            }
+        }
+        write(z, tx, ty, t, tid);
+    }
+};
+
+static void render_pyramid(const Cfg& c, Ctx& x) {
+    Trace tr;
+    tr.on = c.stats || !c.stats_json.empty() || !c.trace.empty();
+    if (!c.csv.empty() || !c.raw.empty() || !c.npy.empty() || c.shard_n > 0) {
+        throw std::runtime_error("--pyramid writes PNG tiles only");
+    }
+    int tn = std::max(1, c.threads);
+    RenderState m(c, x.lut(c.cmap), &tr, tn);
+    m.prepare();
+    std::fputs(m.report.c_str(), stderr);
+    if (m.ranged) {
+        par_for(m.sh, tn, [&](int y, int tid) {
+            Worker& k = m.ws[(size_t) tid];
+            Scope sp(tr, "sample", tid, (double) m.sw);
+            m.row(k, 0, m.sw, y, k.row.data());
+            k.see(k.row.data(), m.sw);
+        });
+    }
+    m.finish_norm();
+    Pyramid p{m, tr, c.pyramid, c.levels, c.tile_size, {}, {}, {}};
+    for (int z = 0; z < p.L; z++) {
+        int s = p.L - 1 - z;
+        p.W.push_back((int) (((long long) c.w + (1LL << s) - 1) >> s));
+        p.H.push_back((int) (((long long) c.h + (1LL << s) - 1) >> s));
+    }
+    p.oo.png_level = c.png_level;
+    p.oo.png_filter = c.png_filter;
+    {
+        Scope sp(tr, "open", 0);
+        for (int z = 0; z < p.L; z++) {
+            for (int tx = 0; tx < p.nx(z); tx++) {
+                std::filesystem::create_directories(p.dir + "/" + std::to_string(z) + "/" + std::to_string(tx));
+            }
+        }
+    }
+    // Subtree roots: the coarsest level with a few per worker, so stealing evens them out.
+    int zr = p.L - 1;
+    for (int z = 0; z < p.L; z++) {
+        if ((long long) p.nx(z) * p.ny(z) >= 4LL * tn) {
+            zr = z;
+            break;
+        }
+    }
+    // Level zr has under 16 tiles per worker unless it is level 0, which need not be kept.
+    size_t ts = (size_t) p.T * p.T * 3;
+    std::vector<std::vector<uint8_t>> lv((size_t) p.nx(zr) * p.ny(zr));
+    par_for((int) lv.size(), tn, [&](int i, int tid) {
+        std::vector<uint8_t> t(ts, 0);
+        p.build(zr, i % p.nx(zr), i / p.nx(zr), tid, t.data());
+        if (zr > 0) {
+            lv[(size_t) i].swap(t);
+        }
+    });
+    // Above the roots, each level from the one below, which is then dropped.
+    for (int z = zr - 1; z >= 0; z--) {
+        std::vector<std::vector<uint8_t>> up((size_t) p.nx(z) * p.ny(z));
+        int cn = p.nx(z + 1);
+        par_for((int) up.size(), tn, [&](int i, int tid) {
+            int tx = i % p.nx(z), ty = i / p.nx(z);
+            up[(size_t) i].assign(ts, 0);
+            for (int d = 0; d < 4; d++) {
+                int cx = 2 * tx + (d & 1), cy = 2 * ty + (d >> 1);
+                if (cx < cn && cy < p.ny(z + 1)) {
+                    Scope sp(tr, "downsample", tid);
+                    p.down(z, tx, ty, d & 1, d >> 1, lv[(size_t) cy * cn + cx].data(), up[(size_t) i].data());
+                }
+            }
+            p.write(z, tx, ty, up[(size_t) i].data(), tid);
+        });
+        lv.swap(up);
+    }
+    if (tr.on) {
+        stats_out(c, tr, evals(m), tn, m.isa);
+    }
+}
+
+void render_file(const Cfg& c0, Ctx& x, Scratch& sc) {
+    if (!c0.pyramid.empty()) {
+        render_pyramid(c0, x);
+        return;
+    }
+    Trace tr;
+    tr.on = c0.stats || !c0.stats_json.empty() || !c0.trace.empty();
+    std::string f = fmt_of(c0);
+    // A shard renders its rows as an image of their own, the same world one row range down.
+    Cfg c = c0;
+    int y0 = 0;
+    bool shard = c0.shard_n > 0;
+    if (shard) {
+        if (!c0.shard_stats && (f != "ppm" || !c0.csv.empty())) {
+            throw std::runtime_error("--shard writes ppm, --raw and --npy only");
+        }
+        if (lo(c0.norm) == "minmax" && lo(c0.oct_cut) == "auto") {
+            throw std::runtime_error("--shard with --normalize minmax needs --octave-cutoff off");
+        }
+        y0 = (int) ((long long) c0.h * c0.shard_i / c0.shard_n);
+        c.h = (int) ((long long) c0.h * (c0.shard_i + 1) / c0.shard_n) - y0;
+        c.oy = c0.oy + y0;
+    }
+    int tn = clampv(c.threads, 1, (c.h + band - 1) / band);
+    RenderState m(c, x.lut(c.cmap), &tr, tn);
+    int sw = m.sw, sh = m.sh;
+    // --cache keeps the sampled block; a hit replaces sampling with a mapped file, and is
+    // looked up before prepare() so that it samples nothing at all.
+    bool cached = !c.cache.empty() && !shard;
+    HfCache hc;
+    Field cf;
+    std::string key;
+    bool hit = false;
+    if (cached) {
+        Scope sp(tr, "cache read", 0);
+        hc.dir = c.cache;
+        hc.cap = (uint64_t) c.cache_max << 20;
+        key = noise_key(m);
+        hit = hc.get(key, (size_t) sw * (size_t) sh, cf);
+        std::fprintf(stderr, "cache: %s %s\n", hit ? "hit" : "miss", HfCache::hash(key).c_str());
+    }
+    if (hit) {
+        m.ev = cf.ev;
+    }
+    m.prepare(!hit);
+    std::fputs(m.report.c_str(), stderr);
+    m.sh_all = c0.tile ? std::min(m.c.tile_p, c0.h) : c0.h;
+    if (shard && c0.shard_stats) {
+        shard_stats(c0, y0, m);
+        return;
+    }
+    // Shards take the normalization from every shard's sidecar instead of their own rows.
+    bool side = shard && m.ranged;
+    if (side) {
+        shard_merge(c0, m);
+    }
+    bool rep = sw < c.w || sh < c.h;
+    int nb = (sh + band - 1) / band;
+    int wave = std::min(nb, tn * 2);
+    size_t bpx = (size_t) band * (size_t) sw;
+    const std::string& mm = m.mm;
+    bool minmax = m.ranged && !side;
+    bool buffer = cached || rep || (minmax && (mm == "buffer" || (mm == "auto" && (size_t) c.w * (size_t) c.h <= ((size_t) 64 << 20))));
+    std::vector<float>& h = sc.h;
+    std::vector<float>& hb = sc.hb;
+    const float* hv = h.data();
+    if (hit) {
+        hv = cf.v;
+        Worker& k0 = m.ws[0];
+        k0.mn = cf.mn;
+        k0.mx = cf.mx;
+        k0.first = false;
+        if (m.hist) {
+            par_for(sh, tn, [&](int y, int tid) {
+                Scope sp(tr, "histogram", tid, (double) sw);
+                m.ws[(size_t) tid].hs.add(hv + (size_t) y * (size_t) sw, sw);
+            });
+        }
+    } else if (buffer) {
+        h.resize((size_t) sw * (size_t) sh);
+        par_for(nb, tn, [&](int b, int tid) { m.sample_band(b, tid, h.data() + (size_t) b * bpx); });
+        hv = h.data();
+        if (cached) {
+            Scope sp(tr, "cache write", 0);
+            float mn = 0.0f, mx = 0.0f;
+            ws_range(m.ws, mn, mx);
+            hc.put(key, hv, h.size(), mn, mx, m.ev);
+        }
+    } else {
+        hb.resize((size_t) wave * bpx);
+    }
+    if (minmax && !buffer) {
+        for (int b0 = 0; b0 < nb; b0 += wave) {
+            par_for(std::min(wave, nb - b0), tn, [&](int i, int tid) { m.sample_band(b0 + i, tid, hb.data() + (size_t) i * bpx); });
+        }
+    }
+    if (!side) {
+        m.finish_norm();
+    }
+    const Norm& nm = m.nm;
+    const uint32_t* lp = m.lp;
+    Isa isa = m.isa;
+    OutOpt oo;
+    oo.threads = tn;
+    oo.png_level = c.png_level;
+    oo.png_filter = c.png_filter;
+    oo.jpeg_quality = c.jpeg_quality;
+    oo.jpeg_sub = c.jpeg_sub;
+    oo.dtype = c.dtype;
+    oo.field = c.field;
+    // A lut of at most 256 colors goes to the PNG as palette (or gray) indices, not RGB.
+    Palette pal;
+    bool ix = f == "png" && c.png_color == "auto" && Palette::of(lp, pal);
+    if (ix) {
+        oo.pal = &pal;
+        lp = pal.ix.data();
+    }
+    size_t bpp = ix ? 1 : 3;
+    auto paint = [&](const float* v, int cnt, uint8_t* d) {
+        if (ix) {
+            colorize_index(v, cnt, nm, lp, d, isa);
+        } else {
+            colorize(v, cnt, nm, lp, d, isa);
+        }
+    };
+    if (shard) {
+        oo.y0 = y0;
+        oo.full_h = c0.h;
+    }
+    std::vector<std::unique_ptr<FieldOut>> fo;
+    std::vector<std::string> fn;
+    std::string in = "write " + f;
+    {
+        Scope sp(tr, "open", 0);
+        if (!c.csv.empty()) {
+            fo.push_back(FieldOut::open(c.csv, "csv", c.w, c.h, nm, oo));
+            fn.push_back("write csv");
+        }
+        if (!c.raw.empty()) {
+            fo.push_back(FieldOut::open(c.raw, "raw", c.w, c.h, nm, oo));
+            fn.push_back("write raw");
+        }
+        if (!c.npy.empty()) {
+            fo.push_back(FieldOut::open(c.npy, "npy", c.w, c.h, nm, oo));
+            fn.push_back("write npy");
+        }
+    }
+    std::unique_ptr<ImageOut> img;
+    {
+        Scope sp(tr, "open", 0);
+        img = ImageOut::open(c.out, f, c.w, c.h, oo);
+    }
+    auto put = [&](const float* v, const uint8_t* rgb, int rows) {
+        for (size_t i = 0; i < fo.size(); i++) {
+            Scope sp(tr, fn[i].c_str(), 0, (double) rows * c.w);
+            fo[i]->rows(v, rows);
+        }
+        Scope sp(tr, in.c_str(), 0, (double) rows * c.w);
+        img->rows(rgb, rows);
+    };
+    std::vector<uint8_t>& ib = sc.ib;
+    if (rep) {
+        std::vector<uint8_t>& blk = sc.blk;
+        blk.resize((size_t) sw * (size_t) sh * bpp);
+        par_for(sh, tn, [&](int y, int tid) {
+            Scope sp(tr, "colorize", tid, (double) sw);
+            size_t o = (size_t) y * (size_t) sw;
+            paint(hv + o, sw, blk.data() + o * bpp);
+        });
+        int wr = tn * 2 * band;
+        size_t row = (size_t) c.w;
+        ib.resize((size_t) wr * row * bpp);
+        hb.resize(fo.empty() ? 0 : (size_t) wr * row);
+        for (int y0 = 0; y0 < c.h; y0 += wr) {
+            int rows = std::min(wr, c.h - y0);
+            par_for(rows, tn, [&](int r, int tid) {
+                Scope sp(tr, "replicate", tid, (double) c.w);
+                size_t sy = (size_t) ((y0 + r) % sh);
+                for (int x = 0; x < c.w; x += sw) {
+                    size_t k = (size_t) std::min(sw, c.w - x);
+                    size_t o = (size_t) r * row + (size_t) x;
+                    std::memcpy(ib.data() + o * bpp, blk.data() + sy * (size_t) sw * bpp, k * bpp);
+                    if (!fo.empty()) {
+                        std::memcpy(hb.data() + o, hv + sy * (size_t) sw, k * sizeof(float));
+                    }
+                }
+            });
+            put(hb.data(), ib.data(), rows);
+        }
+    } else {
+        ib.resize((size_t) wave * bpx * bpp);
+        for (int b0 = 0; b0 < nb; b0 += wave) {
+            int k = std::min(wave, nb - b0);
+            par_for(k, tn, [&](int i, int tid) {
+                int b = b0 + i;
+                const float* v;
+                if (buffer) {
+                    v = hv + (size_t) b * bpx;
+                } else {
+                    float* o = hb.data() + (size_t) i * bpx;
+                    m.sample_band(b, tid, o);
+                    v = o;
+                }
+                int rows = std::min(c.h, (b + 1) * band) - b * band;
+                Scope sp(tr, "colorize", tid, (double) rows * c.w);
+                for (int y = 0; y < rows; y++) {
+                    size_t o = (size_t) y * (size_t) c.w;
+                    paint(v + o, c.w, ib.data() + ((size_t) i * bpx + o) * bpp);
+                }
+            });
+            int rows = std::min(c.h, (b0 + k) * band) - b0 * band;
+            const float* v = buffer ? hv + (size_t) b0 * bpx : hb.data();
+            put(v, ib.data(), rows);
+        }
+    }
+    for (size_t i = 0; i < fo.size(); i++) {
+        Scope sp(tr, fn[i].c_str(), 0);
+        fo[i]->finish();
+    }
+    {
+        Scope sp(tr, in.c_str(), 0);
+        img->finish();
+    }
+    if (tr.on) {
+        stats_out(c, tr, evals(m), tn, isa);
+    }
+}
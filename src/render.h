@@ -0,0 +1,42 @@
+#pragma once
+#include "args.h"
+#include "colormap.h"
+#include "noiseimg.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Settings from the command line (or one --batch line); throws on a bad flag.
+Cfg cfg_from(const Args& a);
+
+// Image buffers one file render needs, kept between batch jobs so they are allocated once.
+struct Scratch {
+    std::vector<float> h, hb;
+    std::vector<uint8_t> ib, blk;
+};
+
+// State shared by every render in the process. Baked colormaps are cached by spec, so
+// file: and json: ramps are read once per batch.
+struct Ctx {
+    std::mutex m;
+    std::unordered_map<std::string, std::shared_ptr<const std::vector<uint32_t>>> luts;
+
+    std::shared_ptr<const std::vector<uint32_t>> lut(const std::string& spec) {
+        {
+            std::lock_guard<std::mutex> g(m);
+            auto it = luts.find(spec);
+            if (it != luts.end()) {
+                return it->second;
+            }
+        }
+        auto v = std::make_shared<const std::vector<uint32_t>>(Colormap::parse(spec).bake());
+        std::lock_guard<std::mutex> g(m);
+        return luts.emplace(spec, v).first->second;
+    }
+};
+
+// Renders c to its image and field files, with --stats and --trace output.
+void render_file(const Cfg& c, Ctx& x, Scratch& sc);
@@ -0,0 +1,371 @@
+#include "serve.h"
+#include "noiseimg.h"
+#include "out.h"
+#include "par.h"
+#include "render.h"
+#include "util.h"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Encoded tiles by request, the least recently used dropped past `cap` bytes. A tile that
+// is being rendered is pending; requests for it wait for that render instead of their own.
+struct Tiles {
+    struct Ent {
+        std::string body, err;
+        int code = 200;
+        bool done = false;
+    };
+    using Lru = std::list<std::pair<std::string, std::shared_ptr<Ent>>>;
+
+    std::mutex m;
+    std::condition_variable cv;
+    Lru lru;  // front: most recent
+    std::unordered_map<std::string, Lru::iterator> at;
+    std::unordered_map<std::string, std::shared_ptr<Ent>> pend;
+    size_t bytes = 0, cap = 0;
+    uint64_t hits = 0, misses = 0, joins = 0, errors = 0;
+
+    // The finished entry for key, made by f on a miss; `how` is hit, miss or coalesced.
+    std::shared_ptr<Ent> get(const std::string& key, const std::function<void(Ent&)>& f, const char*& how) {
+        std::unique_lock<std::mutex> g(m);
+        auto it = at.find(key);
+        if (it != at.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            hits++;
+            how = "hit";
+            return it->second->second;
+        }
+        auto p = pend.find(key);
+        if (p != pend.end()) {
+            std::shared_ptr<Ent> e = p->second;
+            joins++;
+            how = "coalesced";
+            cv.wait(g, [&]() { return e->done; });
+            return e;
+        }
+        auto e = std::make_shared<Ent>();
+        pend[key] = e;
+        misses++;
+        how = "miss";
+        g.unlock();
+        try {
+            f(*e);
+        } catch (const std::exception& x) {
+            e->code = 400;
+            e->err = x.what();
+        }
+        g.lock();
+        e->done = true;
+        pend.erase(key);
+        if (e->code != 200) {
+            errors++;
+        } else if (e->body.size() <= cap) {
+            lru.emplace_front(key, e);
+            at[key] = lru.begin();
+            bytes += e->body.size();
+            while (bytes > cap) {
+                bytes -= lru.back().second->body.size();
+                at.erase(lru.back().first);
+                lru.pop_back();
+            }
+        }
+        cv.notify_all();
+        return e;
+    }
+};
+
+struct Server {
+    Args base;
+    int ts = 256;
+    Tiles tiles;
+};
+
+// Query flags that would touch files, change the tile geometry or the thread budget.
+const char* const banned[] = {"out",   "format", "csv",        "raw",        "npy",         "batch",   "serve",      "serve-cache",
+                              "cache", "shard",  "shard-stats", "stats",     "stats-json",  "trace",   "threads",    "width",
+                              "height", "offset-x", "offset-y", "tile-size", "cache-max"};
+
+std::string unesc(const std::string& s) {
+    std::string r;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '+') {
+            r += ' ';
+        } else if (s[i] == '%' && i + 2 < s.size() && std::isxdigit((unsigned char) s[i + 1]) && std::isxdigit((unsigned char) s[i + 2])) {
+            r += (char) std::stoi(s.substr(i + 1, 2), nullptr, 16);
+            i += 2;
+        } else {
+            r += s[i];
+        }
+    }
+    return r;
+}
+
+// Tile (z, x, y) is the T x T viewport at (x * T, y * T) of the world drawn 2^z times
+// larger: frequencies shrink and pixel-sized lengths grow by 2^z, so every tile covers
+// exactly its four children at z + 1.
+std::string tile_png(const Server& sv, const Args& a, int z, int x, int y) {
+    Cfg c = cfg_from(a);
+    if (lo(c.norm) != "fixed") {
+        throw std::runtime_error("tiles need --normalize fixed (other modes would normalize each tile on its own)");
+    }
+    std::string cm = lo(c.cmap);
+    if (a.has("colormap") && (st(cm, "file:") || st(cm, "json:"))) {
+        throw std::runtime_error("file: and json: colormaps only from the command line");
+    }
+    int T = sv.ts;
+    float s = std::ldexp(1.0f, z);
+    c.w = c.h = T;
+    c.ox = x * T;
+    c.oy = y * T;
+    c.freq /= s;
+    c.warp_freq /= s;
+    c.warp_amp *= s;
+    c.z *= s;
+    if (c.tile) {
+        if ((double) c.tile_p * s > 1e9) {
+            throw std::runtime_error("--tile-period too large at this zoom");
+        }
+        c.tile_p = (int) ((double) c.tile_p * s);
+    }
+    c.threads = 1;
+    Renderer r(c);
+    std::vector<uint8_t> px((size_t) T * (size_t) T * 3u);
+    r.rgb(0, 0, T, T, px.data(), (size_t) T * 3u);
+    OutOpt o;
+    o.png_level = c.png_level;
+    o.png_filter = c.png_filter;
+    std::string png;
+    std::unique_ptr<ImageOut> im = ImageOut::open_mem(png, "png", T, T, o);
+    im->rows(px.data(), T);
+    im->finish();
+    return png;
+}
+
+#if !defined(_WIN32)
+
+void send_all(int fd, const std::string& s) {
+    size_t o = 0;
+    while (o < s.size()) {
+        ssize_t k = ::send(fd, s.data() + o, s.size() - o, 0);
+        if (k <= 0) {
+            return;
+        }
+        o += (size_t) k;
+    }
+}
+
+void reply(int fd, int code, const char* type, const std::string& body, const char* extra = "") {
+    const char* msg = code == 200 ? "OK" : code == 400 ? "Bad Request" : code == 404 ? "Not Found" : "Method Not Allowed";
+    std::string h = "HTTP/1.1 " + std::to_string(code) + " " + msg + "\r\nContent-Type: " + type + "\r\nContent-Length: " + std::to_string(body.size()) +
+                    "\r\nConnection: close\r\n" + extra + "\r\n";
+    send_all(fd, h + body);
+}
+
+void handle(Server& sv, int fd) {
+    std::string req;
+    char b[4096];
+    while (req.find("\r\n\r\n") == std::string::npos && req.size() < 16384) {
+        ssize_t k = ::recv(fd, b, sizeof b, 0);
+        if (k <= 0) {
+            return;
+        }
+        req.append(b, (size_t) k);
+    }
+    std::vector<std::string> l = split(req.substr(0, req.find("\r\n")), ' ');
+    if (l.size() != 3) {
+        reply(fd, 400, "text/plain", "bad request\n");
+        return;
+    }
+    if (l[0] != "GET") {
+        reply(fd, 405, "text/plain", "GET only\n");
+        return;
+    }
+    size_t q = l[1].find('?');
+    std::string path = l[1].substr(0, q);
+    std::string query = q == std::string::npos ? "" : l[1].substr(q + 1);
+    if (path == "/stats") {
+        char j[256];
+        std::unique_lock<std::mutex> g(sv.tiles.m);
+        std::snprintf(j, sizeof j, "{\"hits\":%llu,\"misses\":%llu,\"coalesced\":%llu,\"errors\":%llu,\"tiles\":%zu,\"bytes\":%zu}\n",
+                      (unsigned long long) sv.tiles.hits, (unsigned long long) sv.tiles.misses, (unsigned long long) sv.tiles.joins,
+                      (unsigned long long) sv.tiles.errors, sv.tiles.lru.size(), sv.tiles.bytes);
+        g.unlock();
+        reply(fd, 200, "application/json", j);
+        return;
+    }
+    std::vector<std::string> p = split(path, '/');
+    int z, x, y;
+    if (p.size() != 4 || !p[0].empty() || !en(p[3], ".png") || !parse_i(p[1], z) || !parse_i(p[2], x) ||
+        !parse_i(p[3].substr(0, p[3].size() - 4), y) || z < 0 || z > 24 || std::abs((double) x * sv.ts) > 1e9 ||
+        std::abs((double) y * sv.ts) > 1e9) {
+        reply(fd, 404, "text/plain", "want /{z}/{x}/{y}.png with 0 <= z <= 24\n");
+        return;
+    }
+    // Query flags in a canonical order, so the cache key does not depend on their order.
+    std::vector<std::pair<std::string, std::string>> kv;
+    for (const std::string& s : split(query, '&')) {
+        if (s.empty()) {
+            continue;
+        }
+        size_t e = s.find('=');
+        kv.emplace_back(unesc(s.substr(0, e)), e == std::string::npos ? "true" : unesc(s.substr(e + 1)));
+    }
+    std::sort(kv.begin(), kv.end());
+    Args a = sv.base;
+    std::string key = std::to_string(z) + "/" + std::to_string(x) + "/" + std::to_string(y);
+    for (const auto& e : kv) {
+        if (std::find_if(std::begin(banned), std::end(banned), [&](const char* n) { return e.first == n; }) != std::end(banned)) {
+            reply(fd, 400, "text/plain", "parameter not allowed: " + e.first + "\n");
+            return;
+        }
+        if (e.second == "true" || e.second.empty()) {
+            a.m[e.first] = {};
+        } else if (e.second == "false") {
+            a.m.erase(e.first);
+        } else {
+            a.m[e.first] = {e.second};
+        }
+        key += "\n" + e.first + "=" + e.second;
+    }
+    const char* how = "";
+    std::shared_ptr<Tiles::Ent> t = sv.tiles.get(key, [&](Tiles::Ent& e) { e.body = tile_png(sv, a, z, x, y); }, how);
+    std::string xc = std::string("X-Tile-Cache: ") + how + "\r\n";
+    if (t->code != 200) {
+        reply(fd, t->code, "text/plain", t->err + "\n", xc.c_str());
+        return;
+    }
+    reply(fd, 200, "image/png", t->body, (xc + "Cache-Control: max-age=86400\r\n").c_str());
+}
+
+#endif
+
+}
+
+int serve(const Args& cli) {
+#if defined(_WIN32)
+    (void) cli;
+    throw std::runtime_error("--serve needs POSIX sockets");
+#else
+    std::string addr = cli.get1("serve", "");
+    Server sv;
+    int threads = hw_threads();
+    if (cli.has("threads")) {
+        if (!parse_i(cli.get1("threads", ""), threads) || threads < 1) {
+            throw std::runtime_error("bad --threads");
+        }
+    }
+    if (cli.has("tile-size")) {
+        if (!parse_i(cli.get1("tile-size", ""), sv.ts) || sv.ts < 16 || sv.ts > 4096) {
+            throw std::runtime_error("bad --tile-size (16..4096)");
+        }
+    }
+    int mb = 256;
+    if (cli.has("serve-cache")) {
+        if (!parse_i(cli.get1("serve-cache", ""), mb) || mb < 0) {
+            throw std::runtime_error("bad --serve-cache");
+        }
+    }
+    sv.tiles.cap = (size_t) mb << 20;
+    sv.base = cli;
+    for (const char* k : {"serve", "threads", "tile-size", "serve-cache"}) {
+        sv.base.m.erase(k);
+    }
+    cfg_from(sv.base);
+    std::signal(SIGPIPE, SIG_IGN);
+    int fd;
+    std::string where;
+    if (st(addr, "unix:")) {
+        std::string p = addr.substr(5);
+        sockaddr_un u{};
+        if (p.empty() || p.size() >= sizeof u.sun_path) {
+            throw std::runtime_error("bad --serve socket path: " + p);
+        }
+        u.sun_family = AF_UNIX;
+        std::copy(p.begin(), p.end(), u.sun_path);
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        ::unlink(p.c_str());
+        if (fd < 0 || ::bind(fd, (sockaddr*) &u, sizeof u) != 0) {
+            throw std::runtime_error("cannot bind " + p);
+        }
+        where = "unix:" + p;
+    } else {
+        int port;
+        if (!parse_i(addr, port) || port < 0 || port > 65535) {
+            throw std::runtime_error("bad --serve (want a port or unix:<path>)");
+        }
+        sockaddr_in in{};
+        in.sin_family = AF_INET;
+        in.sin_port = htons((uint16_t) port);
+        in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+        if (fd < 0 || ::bind(fd, (sockaddr*) &in, sizeof in) != 0) {
+            throw std::runtime_error("cannot bind 127.0.0.1:" + addr);
+        }
+        socklen_t n = sizeof in;
+        ::getsockname(fd, (sockaddr*) &in, &n);
+        where = "http://127.0.0.1:" + std::to_string(ntohs(in.sin_port));
+    }
+    if (::listen(fd, 128) != 0) {
+        throw std::runtime_error("cannot listen on " + where);
+    }
+    std::fprintf(stderr, "serving %s/{z}/{x}/{y}.png (%d workers, %dpx tiles, %d MiB cache)\n", where.c_str(), threads, sv.ts, mb);
+    // Connections wait in q for one of `threads` workers, which caps rendering at that many cores.
+    std::mutex qm;
+    std::condition_variable qc;
+    std::deque<int> q;
+    std::vector<std::thread> ws;
+    for (int i = 0; i < threads; i++) {
+        ws.emplace_back([&]() {
+            for (;;) {
+                int c;
+                {
+                    std::unique_lock<std::mutex> g(qm);
+                    qc.wait(g, [&]() { return !q.empty(); });
+                    c = q.front();
+                    q.pop_front();
+                }
+                try {
+                    handle(sv, c);
+                } catch (const std::exception& e) {
+                    std::fprintf(stderr, "serve: %s\n", e.what());
+                }
+                ::close(c);
+            }
+        });
+    }
+    for (;;) {
+        int c = ::accept(fd, nullptr, nullptr);
+        if (c < 0) {
+            continue;
+        }
+        timeval tv{10, 0};
+        ::setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+        std::lock_guard<std::mutex> g(qm);
+        q.push_back(c);
+        qc.notify_one();
+    }
+#endif
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "args.h"
+
+// --serve: answers GET /{z}/{x}/{y}.png?flag=value&... over HTTP on a localhost port or a
+// Unix socket until killed. Command-line flags are defaults for every tile.
+int serve(const Args& cli);
@@ -0,0 +1,355 @@
+#include "simd.h"
+#include "simd_kern.h"
+#include "util.h"
+#include <stdexcept>
+
+#if defined(NOISE_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+struct NoiseBatch {
+    // In 4D, OpenSimplex2S is the same simplex kernel as OpenSimplex2.
+    static bool params(const FastNoiseLite& n, NbParams& p, bool d4 = false) {
+        switch (n.mNoiseType) {
+        case FastNoiseLite::NoiseType_OpenSimplex2:
+            p.type = NbOpenSimplex2;
+            break;
+        case FastNoiseLite::NoiseType_OpenSimplex2S:
+            if (!d4) {
+                return false;
+            }
+            p.type = NbOpenSimplex2;
+            break;
+        case FastNoiseLite::NoiseType_Perlin:
+            p.type = NbPerlin;
+            break;
+        case FastNoiseLite::NoiseType_Value:
+            p.type = NbValue;
+            break;
+        case FastNoiseLite::NoiseType_ValueCubic:
+            if (d4) {
+                return false;
+            }
+            p.type = NbValueCubic;
+            break;
+        case FastNoiseLite::NoiseType_Cellular:
+            if (d4) {
+                return false;
+            }
+            p.type = NbCellular;
+            break;
+        default:
+            return false;
+        }
+        switch (n.mTransformType3D) {
+        case FastNoiseLite::TransformType3D_ImproveXYPlanes:
+            p.xf3 = NbXfImproveXY;
+            break;
+        case FastNoiseLite::TransformType3D_ImproveXZPlanes:
+            p.xf3 = NbXfImproveXZ;
+            break;
+        case FastNoiseLite::TransformType3D_DefaultOpenSimplex2:
+            p.xf3 = NbXfOpenSimplex2;
+            break;
+        default:
+            p.xf3 = NbXfNone;
+            break;
+        }
+        switch (n.mFractalType) {
+        case FastNoiseLite::FractalType_FBm:
+            p.fract = NbFractFBm;
+            break;
+        case FastNoiseLite::FractalType_Ridged:
+            p.fract = NbFractRidged;
+            break;
+        case FastNoiseLite::FractalType_PingPong:
+            p.fract = NbFractPingPong;
+            break;
+        default:
+            p.fract = NbFractNone;
+            break;
+        }
+        p.seed = n.mSeed;
+        p.freq = n.mFrequency;
+        p.oct = n.mOctaves;
+        p.lac = n.mLacunarity;
+        p.gain = n.mGain;
+        p.wstr = n.mWeightedStrength;
+        p.pp = n.mPingPongStrength;
+        p.bound = n.mFractalBounding;
+        p.cdist = (int) n.mCellularDistanceFunction;
+        p.cret = (int) n.mCellularReturnType;
+        p.cjit = n.mCellularJitterModifier;
+        p.g2 = FastNoiseLite::Lookup<float>::Gradients2D;
+        p.g3 = FastNoiseLite::Lookup<float>::Gradients3D;
+        p.g4 = FastNoiseLite::Lookup<float>::Gradients4D;
+        p.r2 = FastNoiseLite::Lookup<float>::RandVecs2D;
+        p.r3 = FastNoiseLite::Lookup<float>::RandVecs3D;
+        return true;
+    }
+
+    // Seed, amplitude and frequency of domain warp octave o, stepped the way
+    // DomainWarpFractalProgressive/Independent step them.
+    static void warp_oct(const FastNoiseLite& n, int o, int& seed, float& amp, float& freq) {
+        seed = n.mSeed;
+        amp = n.mDomainWarpAmp * n.mFractalBounding;
+        freq = n.mFrequency;
+        for (int i = 0; i < o; i++) {
+            seed++;
+            amp *= n.mGain;
+            freq *= n.mLacunarity;
+        }
+    }
+
+    static void warp_params(const FastNoiseLite& n, int o, NbParams& p) {
+        int seed;
+        float amp, freq;
+        warp_oct(n, o, seed, amp, freq);
+        switch (n.mDomainWarpType) {
+        case FastNoiseLite::DomainWarpType_OpenSimplex2:
+            p.type = NbWarpOpenSimplex2;
+            p.amp = amp * 38.283687591552734375f;
+            break;
+        case FastNoiseLite::DomainWarpType_OpenSimplex2Reduced:
+            p.type = NbWarpOpenSimplex2Reduced;
+            p.amp = amp * 16.0f;
+            break;
+        default:
+            p.type = NbWarpBasicGrid;
+            p.amp = amp;
+            break;
+        }
+        p.seed = seed;
+        p.freq = freq;
+        p.g2 = FastNoiseLite::Lookup<float>::Gradients2D;
+        p.r2 = FastNoiseLite::Lookup<float>::RandVecs2D;
+    }
+
+    static float bounding(const FastNoiseLite& n) {
+        return n.mFractalBounding;
+    }
+
+    static void keep(FastNoiseLite& n, int oct) {
+        n.mOctaves = oct;
+    }
+
+    static void warp_scalar(const FastNoiseLite& n, int o, const float* xs, const float* ys, float* dx, float* dy, int cnt) {
+        int seed;
+        float amp, freq;
+        warp_oct(n, o, seed, amp, freq);
+        for (int i = 0; i < cnt; i++) {
+            float x = xs[i];
+            float y = ys[i];
+            float ox = 0.0f;
+            float oy = 0.0f;
+            n.TransformDomainWarpCoordinate(x, y);
+            n.DoSingleDomainWarp(seed, amp, freq, x, y, ox, oy);
+            dx[i] = ox;
+            dy[i] = oy;
+        }
+    }
+};
+
+static Isa detect() {
+#if defined(NOISE_SIMD_X86) && defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 0);
+    int top = r[0];
+    __cpuid(r, 1);
+    bool sse41 = (r[2] & (1 << 19)) != 0;
+    bool osx = (r[2] & (1 << 27)) != 0;
+    bool avx = (r[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (top >= 7 && osx && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(r, 7, 0);
+        avx2 = (r[1] & (1 << 5)) != 0;
+    }
+    return avx2 ? Isa::Avx2 : sse41 ? Isa::Sse41 : Isa::Scalar;
+#elif defined(NOISE_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Isa::Avx2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return Isa::Sse41;
+    }
+    return Isa::Scalar;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+Isa isa_best() {
+    static const Isa i = detect();
+    return i;
+}
+
+Isa isa_parse(const std::string& s) {
+    std::string t = lo(s);
+    Isa want;
+    if (t == "auto") {
+        return isa_best();
+    } else if (t == "avx2") {
+        want = Isa::Avx2;
+    } else if (t == "sse4.1" || t == "sse41") {
+        want = Isa::Sse41;
+    } else if (t == "scalar" || t == "off") {
+        want = Isa::Scalar;
+    } else {
+        throw std::runtime_error("bad --simd: " + s);
+    }
+    return (int) want < (int) isa_best() ? want : isa_best();
+}
+
+const char* isa_name(Isa i) {
+    switch (i) {
+    case Isa::Avx2:
+        return "avx2";
+    case Isa::Sse41:
+        return "sse4.1";
+    default:
+        return "scalar";
+    }
+}
+
+void noise_batch(const FastNoiseLite& n, const float* xs, const float* ys, float* out, int cnt, Isa isa) {
+    NbParams p;
+    if (isa != Isa::Scalar && NoiseBatch::params(n, p)) {
+#if defined(NOISE_SIMD_X86)
+        if (isa == Isa::Avx2) {
+            nb2_avx2(p, xs, ys, out, cnt);
+        } else {
+            nb2_sse41(p, xs, ys, out, cnt);
+        }
+        return;
+#endif
+    }
+    for (int i = 0; i < cnt; i++) {
+        out[i] = n.GetNoise(xs[i], ys[i]);
+    }
+}
+
+void noise_batch(const FastNoiseLite& n, const float* xs, const float* ys, const float* zs, float* out, int cnt, Isa isa) {
+    NbParams p;
+    if (isa != Isa::Scalar && NoiseBatch::params(n, p)) {
+#if defined(NOISE_SIMD_X86)
+        if (isa == Isa::Avx2) {
+            nb3_avx2(p, xs, ys, zs, out, cnt);
+        } else {
+            nb3_sse41(p, xs, ys, zs, out, cnt);
+        }
+        return;
+#endif
+    }
+    for (int i = 0; i < cnt; i++) {
+        out[i] = n.GetNoise(xs[i], ys[i], zs[i]);
+    }
+}
+
+void noise_batch(const FastNoiseLite& n, const float* xs, const float* ys, const float* zs, const float* ws, float* out, int cnt, Isa isa) {
+    NbParams p;
+    if (isa != Isa::Scalar && NoiseBatch::params(n, p, true)) {
+#if defined(NOISE_SIMD_X86)
+        if (isa == Isa::Avx2) {
+            nb4_avx2(p, xs, ys, zs, ws, out, cnt);
+        } else {
+            nb4_sse41(p, xs, ys, zs, ws, out, cnt);
+        }
+        return;
+#endif
+    }
+    for (int i = 0; i < cnt; i++) {
+        out[i] = n.GetNoise(xs[i], ys[i], zs[i], ws[i]);
+    }
+}
+
+// Perlin, Value, ValueCubic and Cellular rows stay lattice-aligned unless a 3D transform rotates them.
+static bool scans(const NbParams& p, bool d3) {
+    return p.type != NbOpenSimplex2 && (!d3 || p.xf3 == NbXfNone);
+}
+
+void noise_row(const FastNoiseLite& n, const float* xs, const float* ys, float* out, int cnt, Isa isa) {
+    NbParams p;
+    if (cnt > 0 && isa != Isa::Scalar && NoiseBatch::params(n, p) && scans(p, false)) {
+#if defined(NOISE_SIMD_X86)
+        if (isa == Isa::Avx2 ? ns2_avx2(p, xs, ys[0], out, cnt) : ns2_sse41(p, xs, ys[0], out, cnt)) {
+            return;
+        }
+#endif
+    }
+    noise_batch(n, xs, ys, out, cnt, isa);
+}
+
+void noise_row(const FastNoiseLite& n, const float* xs, const float* ys, const float* zs, float* out, int cnt, Isa isa) {
+    NbParams p;
+    if (cnt > 0 && isa != Isa::Scalar && NoiseBatch::params(n, p) && scans(p, true)) {
+#if defined(NOISE_SIMD_X86)
+        if (isa == Isa::Avx2 ? ns3_avx2(p, xs, ys[0], zs[0], out, cnt) : ns3_sse41(p, xs, ys[0], zs[0], out, cnt)) {
+            return;
+        }
+#endif
+    }
+    noise_batch(n, xs, ys, zs, out, cnt, isa);
+}
+
+void warp_batch(const FastNoiseLite& n, int o, const float* xs, const float* ys, float* dx, float* dy, int cnt, Isa isa) {
+    if (isa != Isa::Scalar) {
+#if defined(NOISE_SIMD_X86)
+        NbParams p;
+        NoiseBatch::warp_params(n, o, p);
+        if (isa == Isa::Avx2) {
+            nw_avx2(p, xs, ys, dx, dy, cnt);
+        } else {
+            nw_sse41(p, xs, ys, dx, dy, cnt);
+        }
+        return;
+#endif
+    }
+    NoiseBatch::warp_scalar(n, o, xs, ys, dx, dy, cnt);
+}
+
+float fractal_bounding(const FastNoiseLite& n) {
+    return NoiseBatch::bounding(n);
+}
+
+void keep_octaves(FastNoiseLite& n, int oct) {
+    NoiseBatch::keep(n, oct);
+}
+
+void colorize(const float* v, int cnt, const Norm& nm, const uint32_t* lut, uint8_t* rgb, Isa isa) {
+    const float k = (float) (Colormap::lut_n - 1);
+#if defined(NOISE_SIMD_X86)
+    if (isa == Isa::Avx2) {
+        colorize_avx2(v, cnt, nm.s, nm.q, nm.o, k, lut, rgb);
+        return;
+    }
+    if (isa == Isa::Sse41) {
+        colorize_sse41(v, cnt, nm.s, nm.q, nm.o, k, lut, rgb);
+        return;
+    }
+#else
+    (void) isa;
+#endif
+    for (int i = 0; i < cnt; i++) {
+        colorize_px(v[i], nm.s, nm.q, nm.o, k, lut, rgb + (size_t) i * 3u);
+    }
+}
+
+void colorize_index(const float* v, int cnt, const Norm& nm, const uint32_t* ix, uint8_t* out, Isa isa) {
+    const float k = (float) (Colormap::lut_n - 1);
+#if defined(NOISE_SIMD_X86)
+    if (isa == Isa::Avx2) {
+        colorize_index_avx2(v, cnt, nm.s, nm.q, nm.o, k, ix, out);
+        return;
+    }
+    if (isa == Isa::Sse41) {
+        colorize_index_sse41(v, cnt, nm.s, nm.q, nm.o, k, ix, out);
+        return;
+    }
+#else
+    (void) isa;
+#endif
+    for (int i = 0; i < cnt; i++) {
+        out[i] = (uint8_t) ix[lut_px(v[i], nm.s, nm.q, nm.o, k)];
+    }
+}
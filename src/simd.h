@@ -0,0 +1,47 @@
+#pragma once
+#include "FastNoiseLite.h"
+#include "colormap.h"
+#include <cstdint>
+#include <string>
+
+enum class Isa { Scalar, Sse41, Avx2 };
+
+Isa isa_best();
+Isa isa_parse(const std::string& s);
+const char* isa_name(Isa i);
+
+// Batched FastNoiseLite::GetNoise over cnt points. OpenSimplex2, Perlin, Value, ValueCubic
+// and Cellular (2D and 3D, any fractal type) run on vector kernels when `isa` allows; other
+// noise types fall back to the scalar call. Results are bit-identical either way.
+void noise_batch(const FastNoiseLite& n, const float* xs, const float* ys, float* out, int cnt, Isa isa);
+void noise_batch(const FastNoiseLite& n, const float* xs, const float* ys, const float* zs, float* out, int cnt, Isa isa);
+// 4D (GetNoise(x, y, z, w)): OpenSimplex2/OpenSimplex2S, Perlin and Value only.
+void noise_batch(const FastNoiseLite& n, const float* xs, const float* ys, const float* zs, const float* ws, float* out, int cnt, Isa isa);
+
+// noise_batch for a row whose ys (and zs) are all equal; only ys[0] (zs[0]) is read on the
+// fast path. Perlin, Value and ValueCubic without a 3D rotation hash each lattice cell once
+// per octave and sweep its pixels; Cellular generates the feature points of the cells the
+// row touches once per octave and shares them between all pixels near the same cell. This
+// pays off when cells span several pixels (low frequencies); other settings and rows too
+// fine to scan go through noise_batch. Same results either way.
+void noise_row(const FastNoiseLite& n, const float* xs, const float* ys, float* out, int cnt, Isa isa);
+void noise_row(const FastNoiseLite& n, const float* xs, const float* ys, const float* zs, float* out, int cnt, Isa isa);
+
+// Displacement that octave o of FastNoiseLite::DomainWarp(x, y) adds at each point, both
+// axes from one gradient lookup: seed, amplitude and frequency are stepped o times as the
+// fractal warp loops step them. Coordinates go in untransformed. All three warp types have
+// vector kernels, bit-identical to the scalar DoSingleDomainWarp.
+void warp_batch(const FastNoiseLite& n, int o, const float* xs, const float* ys, float* dx, float* dy, int cnt, Isa isa);
+
+// Amplitude of the first fractal octave. keep_octaves makes n evaluate only its first `oct`
+// octaves from now on without touching that bounding, so the octaves kept sum exactly as
+// they did before; FastNoiseLite::SetFractalOctaves would rescale them.
+float fractal_bounding(const FastNoiseLite& n);
+void keep_octaves(FastNoiseLite& n, int oct);
+
+// Fused normalize + lut lookup + RGB interleave of cnt values into 3 * cnt bytes.
+// `lut` is a table from Colormap::bake().
+void colorize(const float* v, int cnt, const Norm& nm, const uint32_t* lut, uint8_t* rgb, Isa isa);
+
+// The same with Palette::ix for the lut, writing one palette index byte per value.
+void colorize_index(const float* v, int cnt, const Norm& nm, const uint32_t* ix, uint8_t* out, Isa isa);
@@ -0,0 +1,160 @@
+#include "simd_kern.h"
+#include <immintrin.h>
+
+namespace {
+
+constexpr int W = 8;
+
+struct M {
+    __m256 v;
+};
+
+struct F {
+    __m256 v;
+    F() = default;
+    explicit F(__m256 a) : v(a) {}
+    explicit F(float a) : v(_mm256_set1_ps(a)) {}
+};
+
+struct I {
+    __m256i v;
+    I() = default;
+    explicit I(__m256i a) : v(a) {}
+    explicit I(int a) : v(_mm256_set1_epi32(a)) {}
+};
+
+inline F operator+(F a, F b) { return F(_mm256_add_ps(a.v, b.v)); }
+inline F operator-(F a, F b) { return F(_mm256_sub_ps(a.v, b.v)); }
+inline F operator*(F a, F b) { return F(_mm256_mul_ps(a.v, b.v)); }
+inline F operator/(F a, F b) { return F(_mm256_div_ps(a.v, b.v)); }
+inline F operator-(F a) { return F(_mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f))); }
+inline M operator<(F a, F b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+inline M operator<=(F a, F b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+inline M operator>(F a, F b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+inline M operator>=(F a, F b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+inline M nge(F a, F b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_NGE_UQ)}; }
+inline M operator&(M a, M b) { return {_mm256_and_ps(a.v, b.v)}; }
+inline M operator|(M a, M b) { return {_mm256_or_ps(a.v, b.v)}; }
+inline M operator~(M a) { return {_mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1)))}; }
+inline M andnot(M a, M b) { return {_mm256_andnot_ps(a.v, b.v)}; }
+inline F min_(F a, F b) { return F(_mm256_min_ps(a.v, b.v)); }
+inline F max_(F a, F b) { return F(_mm256_max_ps(a.v, b.v)); }
+inline F sqrt_(F a) { return F(_mm256_sqrt_ps(a.v)); }
+inline F sel(M m, F a, F b) { return F(_mm256_blendv_ps(b.v, a.v, m.v)); }
+
+inline I operator+(I a, I b) { return I(_mm256_add_epi32(a.v, b.v)); }
+inline I operator-(I a, I b) { return I(_mm256_sub_epi32(a.v, b.v)); }
+inline I operator*(I a, I b) { return I(_mm256_mullo_epi32(a.v, b.v)); }
+inline I operator^(I a, I b) { return I(_mm256_xor_si256(a.v, b.v)); }
+inline I operator&(I a, I b) { return I(_mm256_and_si256(a.v, b.v)); }
+inline I operator|(I a, I b) { return I(_mm256_or_si256(a.v, b.v)); }
+inline I sra(I a, int n) { return I(_mm256_srai_epi32(a.v, n)); }
+inline I sll(I a, int n) { return I(_mm256_slli_epi32(a.v, n)); }
+inline bool all_eq(I a, I b) { return _mm256_movemask_epi8(_mm256_cmpeq_epi32(a.v, b.v)) == -1; }
+inline I as_i(M m) { return I(_mm256_castps_si256(m.v)); }
+inline I seli(M m, I a, I b) {
+    return I(_mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), m.v)));
+}
+
+inline F cvt(I a) { return F(_mm256_cvtepi32_ps(a.v)); }
+inline I cvtt(F a) { return I(_mm256_cvttps_epi32(a.v)); }
+inline F gather(const float* t, I i) { return F(_mm256_i32gather_ps(t, i.v, 4)); }
+
+inline F load(const float* p, int m) {
+    if (m == W) {
+        return F(_mm256_loadu_ps(p));
+    }
+    alignas(32) float b[W] = {};
+    for (int i = 0; i < m; i++) {
+        b[i] = p[i];
+    }
+    return F(_mm256_load_ps(b));
+}
+
+inline void store(float* p, F v, int m) {
+    if (m == W) {
+        _mm256_storeu_ps(p, v.v);
+        return;
+    }
+    alignas(32) float b[W];
+    _mm256_store_ps(b, v.v);
+    for (int i = 0; i < m; i++) {
+        p[i] = b[i];
+    }
+}
+
+#include "simd_body.h"
+
+}
+
+void nb2_avx2(const NbParams& p, const float* xs, const float* ys, float* out, int n) {
+    run2(p, xs, ys, out, n);
+}
+
+void nb3_avx2(const NbParams& p, const float* xs, const float* ys, const float* zs, float* out, int n) {
+    run3(p, xs, ys, zs, out, n);
+}
+
+void nb4_avx2(const NbParams& p, const float* xs, const float* ys, const float* zs, const float* ws, float* out, int n) {
+    run4(p, xs, ys, zs, ws, out, n);
+}
+
+bool ns2_avx2(const NbParams& p, const float* xs, float y, float* out, int n) {
+    return scan2(p, xs, y, out, n);
+}
+
+bool ns3_avx2(const NbParams& p, const float* xs, float y, float z, float* out, int n) {
+    return scan3(p, xs, y, z, out, n);
+}
+
+void nw_avx2(const NbParams& p, const float* xs, const float* ys, float* dx, float* dy, int n) {
+    runw(p, xs, ys, dx, dy, n);
+}
+
+void colorize_avx2(const float* v, int n, float s, float q, float o, float k, const uint32_t* lut, uint8_t* rgb) {
+    const __m256 vs = _mm256_set1_ps(s), vq = _mm256_set1_ps(q), vo = _mm256_set1_ps(o);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    const __m256 vk = _mm256_set1_ps(k), half = _mm256_set1_ps(0.5f);
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 t = _mm256_add_ps(_mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(v + i), vs), vq), vo);
+        t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+        __m256i idx = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(t, vk), half));
+        __m256i c = _mm256_i32gather_epi32((const int*) lut, idx, 4);
+        __m128i a = _mm_shuffle_epi8(_mm256_castsi256_si128(c), pack);
+        __m128i b = _mm_shuffle_epi8(_mm256_extracti128_si256(c, 1), pack);
+        uint8_t* d = rgb + (size_t) i * 3u;
+        uint32_t ta = (uint32_t) _mm_extract_epi32(a, 2);
+        uint32_t tb = (uint32_t) _mm_extract_epi32(b, 2);
+        _mm_storel_epi64((__m128i*) d, a);
+        std::memcpy(d + 8, &ta, 4);
+        _mm_storel_epi64((__m128i*) (d + 12), b);
+        std::memcpy(d + 20, &tb, 4);
+    }
+    for (; i < n; i++) {
+        colorize_px(v[i], s, q, o, k, lut, rgb + (size_t) i * 3u);
+    }
+}
+
+void colorize_index_avx2(const float* v, int n, float s, float q, float o, float k, const uint32_t* ix, uint8_t* out) {
+    const __m256 vs = _mm256_set1_ps(s), vq = _mm256_set1_ps(q), vo = _mm256_set1_ps(o);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    const __m256 vk = _mm256_set1_ps(k), half = _mm256_set1_ps(0.5f);
+    const __m256i pack = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 t = _mm256_add_ps(_mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(v + i), vs), vq), vo);
+        t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+        __m256i idx = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(t, vk), half));
+        __m256i c = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int*) ix, idx, 4), pack);
+        uint32_t a = (uint32_t) _mm256_extract_epi32(c, 0);
+        uint32_t b = (uint32_t) _mm256_extract_epi32(c, 4);
+        std::memcpy(out + i, &a, 4);
+        std::memcpy(out + i + 4, &b, 4);
+    }
+    for (; i < n; i++) {
+        out[i] = (uint8_t) ix[lut_px(v[i], s, q, o, k)];
+    }
+}
@@ -0,0 +1,1647 @@
+// Vector kernels mirroring FastNoiseLite's scalar code operation for operation,
+// so every lane is bit-identical to GetNoise. Included once per instruction set
+// from inside an anonymous namespace, after the including file has defined the
+// lane count W, the vector types F (float), I (int32), M (mask) and the helpers
+// used below (load, store, cvt, cvtt, sra, sll, sel, seli, gather, nge, min_, max_, sqrt_,
+// all_eq).
+
+constexpr int PX = 501125321;
+constexpr int PY = 1136930381;
+constexpr int PZ = 1720413743;
+constexpr int PW = 1066037191;
+
+inline I ffloor(F f) {
+    return cvtt(f) + as_i(nge(f, F(0.0f)));
+}
+
+inline I fround(F f) {
+    return cvtt(sel(f >= F(0.0f), f + F(0.5f), f - F(0.5f)));
+}
+
+inline F lerp(F a, F b, F t) {
+    return a + t * (b - a);
+}
+
+inline F hermite(F t) {
+    return t * t * (F(3.0f) - F(2.0f) * t);
+}
+
+inline F quintic(F t) {
+    return t * t * t * (t * (t * F(6.0f) - F(15.0f)) + F(10.0f));
+}
+
+inline F fabs_(F f) {
+    return sel(f < F(0.0f), -f, f);
+}
+
+inline I hash2(int seed, I x, I y) {
+    I h = I(seed) ^ x ^ y;
+    return h * I(0x27d4eb2d);
+}
+
+inline I hash3(int seed, I x, I y, I z) {
+    I h = I(seed) ^ x ^ y ^ z;
+    return h * I(0x27d4eb2d);
+}
+
+inline I hash4(int seed, I x, I y, I z, I w) {
+    I h = I(seed) ^ x ^ y ^ z ^ w;
+    return h * I(0x27d4eb2d);
+}
+
+inline F valc2(int seed, I x, I y) {
+    I h = hash2(seed, x, y);
+    h = h * h;
+    h = h ^ sll(h, 19);
+    return cvt(h) * F(1 / 2147483648.0f);
+}
+
+inline F valc3(int seed, I x, I y, I z) {
+    I h = hash3(seed, x, y, z);
+    h = h * h;
+    h = h ^ sll(h, 19);
+    return cvt(h) * F(1 / 2147483648.0f);
+}
+
+inline F valc4(int seed, I x, I y, I z, I w) {
+    I h = hash4(seed, x, y, z, w);
+    h = h * h;
+    h = h ^ sll(h, 19);
+    return cvt(h) * F(1 / 2147483648.0f);
+}
+
+inline void gvec2(const NbParams& p, int seed, I x, I y, F& xg, F& yg) {
+    I h = hash2(seed, x, y);
+    h = h ^ sra(h, 15);
+    h = h & I(127 << 1);
+    xg = gather(p.g2, h);
+    yg = gather(p.g2, h | I(1));
+}
+
+inline void gvec3(const NbParams& p, int seed, I x, I y, I z, F& xg, F& yg, F& zg) {
+    I h = hash3(seed, x, y, z);
+    h = h ^ sra(h, 15);
+    h = h & I(63 << 2);
+    xg = gather(p.g3, h);
+    yg = gather(p.g3, h | I(1));
+    zg = gather(p.g3, h | I(2));
+}
+
+inline F grad2(const NbParams& p, int seed, I x, I y, F xd, F yd) {
+    F xg, yg;
+    gvec2(p, seed, x, y, xg, yg);
+    return xd * xg + yd * yg;
+}
+
+inline F grad3(const NbParams& p, int seed, I x, I y, I z, F xd, F yd, F zd) {
+    F xg, yg, zg;
+    gvec3(p, seed, x, y, z, xg, yg, zg);
+    return xd * xg + yd * yg + zd * zg;
+}
+
+inline F grad4(const NbParams& p, int seed, I x, I y, I z, I w, F xd, F yd, F zd, F wd) {
+    I h = hash4(seed, x, y, z, w);
+    h = h ^ sra(h, 15);
+    h = h & I(63 << 2);
+    F xg = gather(p.g4, h);
+    F yg = gather(p.g4, h | I(1));
+    F zg = gather(p.g4, h | I(2));
+    F wg = gather(p.g4, h | I(3));
+    return xd * xg + yd * yg + zd * zg + wd * wg;
+}
+
+inline void gout2(const NbParams& p, int seed, I x, I y, F& xo, F& yo) {
+    I h = hash2(seed, x, y) & I(255 << 1);
+    xo = gather(p.r2, h);
+    yo = gather(p.r2, h | I(1));
+}
+
+inline void gdual2(const NbParams& p, int seed, I x, I y, F xd, F yd, F& xo, F& yo) {
+    I h = hash2(seed, x, y);
+    I i1 = h & I(127 << 1);
+    I i2 = sra(h, 7) & I(255 << 1);
+    F v = xd * gather(p.g2, i1) + yd * gather(p.g2, i1 | I(1));
+    xo = v * gather(p.r2, i2);
+    yo = v * gather(p.r2, i2 | I(1));
+}
+
+F perlin2(const NbParams& p, int seed, F x, F y) {
+    I x0 = ffloor(x);
+    I y0 = ffloor(y);
+    F xd0 = x - cvt(x0);
+    F yd0 = y - cvt(y0);
+    F xd1 = xd0 - F(1.0f);
+    F yd1 = yd0 - F(1.0f);
+    F xs = quintic(xd0);
+    F ys = quintic(yd0);
+    x0 = x0 * I(PX);
+    y0 = y0 * I(PY);
+    I x1 = x0 + I(PX);
+    I y1 = y0 + I(PY);
+    F xf0 = lerp(grad2(p, seed, x0, y0, xd0, yd0), grad2(p, seed, x1, y0, xd1, yd0), xs);
+    F xf1 = lerp(grad2(p, seed, x0, y1, xd0, yd1), grad2(p, seed, x1, y1, xd1, yd1), xs);
+    return lerp(xf0, xf1, ys) * F(1.4247691104677813f);
+}
+
+F perlin3(const NbParams& p, int seed, F x, F y, F z) {
+    I x0 = ffloor(x);
+    I y0 = ffloor(y);
+    I z0 = ffloor(z);
+    F xd0 = x - cvt(x0);
+    F yd0 = y - cvt(y0);
+    F zd0 = z - cvt(z0);
+    F xd1 = xd0 - F(1.0f);
+    F yd1 = yd0 - F(1.0f);
+    F zd1 = zd0 - F(1.0f);
+    F xs = quintic(xd0);
+    F ys = quintic(yd0);
+    F zs = quintic(zd0);
+    x0 = x0 * I(PX);
+    y0 = y0 * I(PY);
+    z0 = z0 * I(PZ);
+    I x1 = x0 + I(PX);
+    I y1 = y0 + I(PY);
+    I z1 = z0 + I(PZ);
+    F xf00 = lerp(grad3(p, seed, x0, y0, z0, xd0, yd0, zd0), grad3(p, seed, x1, y0, z0, xd1, yd0, zd0), xs);
+    F xf10 = lerp(grad3(p, seed, x0, y1, z0, xd0, yd1, zd0), grad3(p, seed, x1, y1, z0, xd1, yd1, zd0), xs);
+    F xf01 = lerp(grad3(p, seed, x0, y0, z1, xd0, yd0, zd1), grad3(p, seed, x1, y0, z1, xd1, yd0, zd1), xs);
+    F xf11 = lerp(grad3(p, seed, x0, y1, z1, xd0, yd1, zd1), grad3(p, seed, x1, y1, z1, xd1, yd1, zd1), xs);
+    F yf0 = lerp(xf00, xf10, ys);
+    F yf1 = lerp(xf01, xf11, ys);
+    return lerp(yf0, yf1, zs) * F(0.964921414852142333984375f);
+}
+
+F perlin4(const NbParams& p, int seed, F x, F y, F z, F w) {
+    I x0 = ffloor(x);
+    I y0 = ffloor(y);
+    I z0 = ffloor(z);
+    I w0 = ffloor(w);
+    F xd0 = x - cvt(x0);
+    F yd0 = y - cvt(y0);
+    F zd0 = z - cvt(z0);
+    F wd0 = w - cvt(w0);
+    F xd1 = xd0 - F(1.0f);
+    F yd1 = yd0 - F(1.0f);
+    F zd1 = zd0 - F(1.0f);
+    F wd1 = wd0 - F(1.0f);
+    F xs = quintic(xd0);
+    F ys = quintic(yd0);
+    F zs = quintic(zd0);
+    F ws = quintic(wd0);
+    x0 = x0 * I(PX);
+    y0 = y0 * I(PY);
+    z0 = z0 * I(PZ);
+    w0 = w0 * I(PW);
+    I x1 = x0 + I(PX);
+    I y1 = y0 + I(PY);
+    I z1 = z0 + I(PZ);
+    I w1 = w0 + I(PW);
+    F wf[2];
+    for (int d = 0; d < 2; d++) {
+        I wp = d ? w1 : w0;
+        F wd = d ? wd1 : wd0;
+        F xf00 = lerp(grad4(p, seed, x0, y0, z0, wp, xd0, yd0, zd0, wd), grad4(p, seed, x1, y0, z0, wp, xd1, yd0, zd0, wd), xs);
+        F xf10 = lerp(grad4(p, seed, x0, y1, z0, wp, xd0, yd1, zd0, wd), grad4(p, seed, x1, y1, z0, wp, xd1, yd1, zd0, wd), xs);
+        F xf01 = lerp(grad4(p, seed, x0, y0, z1, wp, xd0, yd0, zd1, wd), grad4(p, seed, x1, y0, z1, wp, xd1, yd0, zd1, wd), xs);
+        F xf11 = lerp(grad4(p, seed, x0, y1, z1, wp, xd0, yd1, zd1, wd), grad4(p, seed, x1, y1, z1, wp, xd1, yd1, zd1, wd), xs);
+        F yf0 = lerp(xf00, xf10, ys);
+        F yf1 = lerp(xf01, xf11, ys);
+        wf[d] = lerp(yf0, yf1, zs);
+    }
+    return lerp(wf[0], wf[1], ws) * F(0.83f);
+}
+
+F value2(const NbParams&, int seed, F x, F y) {
+    I x0 = ffloor(x);
+    I y0 = ffloor(y);
+    F xs = hermite(x - cvt(x0));
+    F ys = hermite(y - cvt(y0));
+    x0 = x0 * I(PX);
+    y0 = y0 * I(PY);
+    I x1 = x0 + I(PX);
+    I y1 = y0 + I(PY);
+    F xf0 = lerp(valc2(seed, x0, y0), valc2(seed, x1, y0), xs);
+    F xf1 = lerp(valc2(seed, x0, y1), valc2(seed, x1, y1), xs);
+    return lerp(xf0, xf1, ys);
+}
+
+F value3(const NbParams&, int seed, F x, F y, F z) {
+    I x0 = ffloor(x);
+    I y0 = ffloor(y);
+    I z0 = ffloor(z);
+    F xs = hermite(x - cvt(x0));
+    F ys = hermite(y - cvt(y0));
+    F zs = hermite(z - cvt(z0));
+    x0 = x0 * I(PX);
+    y0 = y0 * I(PY);
+    z0 = z0 * I(PZ);
+    I x1 = x0 + I(PX);
+    I y1 = y0 + I(PY);
+    I z1 = z0 + I(PZ);
+    F xf00 = lerp(valc3(seed, x0, y0, z0), valc3(seed, x1, y0, z0), xs);
+    F xf10 = lerp(valc3(seed, x0, y1, z0), valc3(seed, x1, y1, z0), xs);
+    F xf01 = lerp(valc3(seed, x0, y0, z1), valc3(seed, x1, y0, z1), xs);
+    F xf11 = lerp(valc3(seed, x0, y1, z1), valc3(seed, x1, y1, z1), xs);
+    F yf0 = lerp(xf00, xf10, ys);
+    F yf1 = lerp(xf01, xf11, ys);
+    return lerp(yf0, yf1, zs);
+}
+
+inline F cubic(F a, F b, F c, F d, F t) {
+    F p = (d - c) - (a - b);
+    return t * t * t * p + t * t * ((a - b) - p) + t * (c - a) + b;
+}
+
+// (int)((long)Prime << 1) as FastNoiseLite writes it, wrapped to 32 bits.
+constexpr int PX2 = (int) (unsigned) ((unsigned) PX << 1);
+constexpr int PY2 = (int) (unsigned) ((unsigned) PY << 1);
+constexpr int PZ2 = (int) (unsigned) ((unsigned) PZ << 1);
+
+inline F vcrow2(int seed, I x1, I y, F xs) {
+    return cubic(valc2(seed, x1 - I(PX), y), valc2(seed, x1, y), valc2(seed, x1 + I(PX), y), valc2(seed, x1 + I(PX2), y), xs);
+}
+
+inline F vcrow3(int seed, I x1, I y, I z, F xs) {
+    return cubic(valc3(seed, x1 - I(PX), y, z), valc3(seed, x1, y, z), valc3(seed, x1 + I(PX), y, z), valc3(seed, x1 + I(PX2), y, z), xs);
+}
+
+F vcubic2(const NbParams&, int seed, F x, F y) {
+    I x1 = ffloor(x);
+    I y1 = ffloor(y);
+    F xs = x - cvt(x1);
+    F ys = y - cvt(y1);
+    x1 = x1 * I(PX);
+    y1 = y1 * I(PY);
+    F r0 = vcrow2(seed, x1, y1 - I(PY), xs);
+    F r1 = vcrow2(seed, x1, y1, xs);
+    F r2 = vcrow2(seed, x1, y1 + I(PY), xs);
+    F r3 = vcrow2(seed, x1, y1 + I(PY2), xs);
+    return cubic(r0, r1, r2, r3, ys) * F(1 / (1.5f * 1.5f));
+}
+
+F vcubic3(const NbParams&, int seed, F x, F y, F z) {
+    I x1 = ffloor(x);
+    I y1 = ffloor(y);
+    I z1 = ffloor(z);
+    F xs = x - cvt(x1);
+    F ys = y - cvt(y1);
+    F zs = z - cvt(z1);
+    x1 = x1 * I(PX);
+    y1 = y1 * I(PY);
+    z1 = z1 * I(PZ);
+    I yv[4] = {y1 - I(PY), y1, y1 + I(PY), y1 + I(PY2)};
+    I zv[4] = {z1 - I(PZ), z1, z1 + I(PZ), z1 + I(PZ2)};
+    F zf[4];
+    for (int c = 0; c < 4; c++) {
+        F r0 = vcrow3(seed, x1, yv[0], zv[c], xs);
+        F r1 = vcrow3(seed, x1, yv[1], zv[c], xs);
+        F r2 = vcrow3(seed, x1, yv[2], zv[c], xs);
+        F r3 = vcrow3(seed, x1, yv[3], zv[c], xs);
+        zf[c] = cubic(r0, r1, r2, r3, ys);
+    }
+    return cubic(zf[0], zf[1], zf[2], zf[3], zs) * F(1 / (1.5f * 1.5f * 1.5f));
+}
+
+F value4(const NbParams&, int seed, F x, F y, F z, F w) {
+    I x0 = ffloor(x);
+    I y0 = ffloor(y);
+    I z0 = ffloor(z);
+    I w0 = ffloor(w);
+    F xs = hermite(x - cvt(x0));
+    F ys = hermite(y - cvt(y0));
+    F zs = hermite(z - cvt(z0));
+    F ws = hermite(w - cvt(w0));
+    x0 = x0 * I(PX);
+    y0 = y0 * I(PY);
+    z0 = z0 * I(PZ);
+    w0 = w0 * I(PW);
+    I x1 = x0 + I(PX);
+    I y1 = y0 + I(PY);
+    I z1 = z0 + I(PZ);
+    I w1 = w0 + I(PW);
+    F wf[2];
+    for (int d = 0; d < 2; d++) {
+        I wp = d ? w1 : w0;
+        F xf00 = lerp(valc4(seed, x0, y0, z0, wp), valc4(seed, x1, y0, z0, wp), xs);
+        F xf10 = lerp(valc4(seed, x0, y1, z0, wp), valc4(seed, x1, y1, z0, wp), xs);
+        F xf01 = lerp(valc4(seed, x0, y0, z1, wp), valc4(seed, x1, y0, z1, wp), xs);
+        F xf11 = lerp(valc4(seed, x0, y1, z1, wp), valc4(seed, x1, y1, z1, wp), xs);
+        F yf0 = lerp(xf00, xf10, ys);
+        F yf1 = lerp(xf01, xf11, ys);
+        wf[d] = lerp(yf0, yf1, zs);
+    }
+    return lerp(wf[0], wf[1], ws);
+}
+
+F simplex2(const NbParams& p, int seed, F x, F y) {
+    const float SQRT3 = 1.7320508075688772935274463415059f;
+    const float G2 = (3 - SQRT3) / 6;
+    I i = ffloor(x);
+    I j = ffloor(y);
+    F xi = x - cvt(i);
+    F yi = y - cvt(j);
+    F t = (xi + yi) * F(G2);
+    F x0 = xi - t;
+    F y0 = yi - t;
+    i = i * I(PX);
+    j = j * I(PY);
+    F zero(0.0f);
+
+    F a = F(0.5f) - x0 * x0 - y0 * y0;
+    F n0 = sel(a <= zero, zero, (a * a) * (a * a) * grad2(p, seed, i, j, x0, y0));
+
+    F c = F((float) (2 * (1 - 2 * G2) * (1 / G2 - 2))) * t + (F((float) (-2 * (1 - 2 * G2) * (1 - 2 * G2))) + a);
+    F x2 = x0 + F(2 * (float) G2 - 1);
+    F y2 = y0 + F(2 * (float) G2 - 1);
+    F n2 = sel(c <= zero, zero, (c * c) * (c * c) * grad2(p, seed, i + I(PX), j + I(PY), x2, y2));
+
+    M up = y0 > x0;
+    F x1 = sel(up, x0 + F((float) G2), x0 + F((float) G2 - 1));
+    F y1 = sel(up, y0 + F((float) G2 - 1), y0 + F((float) G2));
+    F b = F(0.5f) - x1 * x1 - y1 * y1;
+    I i1 = seli(up, i, i + I(PX));
+    I j1 = seli(up, j + I(PY), j);
+    F n1 = sel(b <= zero, zero, (b * b) * (b * b) * grad2(p, seed, i1, j1, x1, y1));
+
+    return (n0 + n1 + n2) * F(99.83685446303647f);
+}
+
+F simplex3(const NbParams& p, int seed, F x, F y, F z) {
+    I i = fround(x);
+    I j = fround(y);
+    I k = fround(z);
+    F x0 = x - cvt(i);
+    F y0 = y - cvt(j);
+    F z0 = z - cvt(k);
+
+    I xs = cvtt(F(-1.0f) - x0) | I(1);
+    I ys = cvtt(F(-1.0f) - y0) | I(1);
+    I zs = cvtt(F(-1.0f) - z0) | I(1);
+
+    F ax0 = cvt(xs) * -x0;
+    F ay0 = cvt(ys) * -y0;
+    F az0 = cvt(zs) * -z0;
+
+    i = i * I(PX);
+    j = j * I(PY);
+    k = k * I(PZ);
+
+    F zero(0.0f);
+    F value = zero;
+    F a = (F(0.6f) - x0 * x0) - (y0 * y0 + z0 * z0);
+
+    for (int l = 0;; l++) {
+        value = value + sel(a > zero, (a * a) * (a * a) * grad3(p, seed, i, j, k, x0, y0, z0), zero);
+
+        M mx = (ax0 >= ay0) & (ax0 >= az0);
+        M my = andnot(mx, (ay0 > ax0) & (ay0 >= az0));
+        M mz = ~(mx | my);
+        F x1 = sel(mx, x0 + cvt(xs), x0);
+        F y1 = sel(my, y0 + cvt(ys), y0);
+        F z1 = sel(mz, z0 + cvt(zs), z0);
+        F b = a + F(1.0f);
+        b = sel(mx, b - cvt(xs * I(2)) * x1, b);
+        b = sel(my, b - cvt(ys * I(2)) * y1, b);
+        b = sel(mz, b - cvt(zs * I(2)) * z1, b);
+        I i1 = seli(mx, i - xs * I(PX), i);
+        I j1 = seli(my, j - ys * I(PY), j);
+        I k1 = seli(mz, k - zs * I(PZ), k);
+
+        value = value + sel(b > zero, (b * b) * (b * b) * grad3(p, seed, i1, j1, k1, x1, y1, z1), zero);
+
+        if (l == 1) {
+            break;
+        }
+
+        ax0 = F(0.5f) - ax0;
+        ay0 = F(0.5f) - ay0;
+        az0 = F(0.5f) - az0;
+
+        x0 = cvt(xs) * ax0;
+        y0 = cvt(ys) * ay0;
+        z0 = cvt(zs) * az0;
+
+        a = a + ((F(0.75f) - ax0) - (ay0 + az0));
+
+        i = i + (sra(xs, 1) & I(PX));
+        j = j + (sra(ys, 1) & I(PY));
+        k = k + (sra(zs, 1) & I(PZ));
+
+        xs = I(0) - xs;
+        ys = I(0) - ys;
+        zs = I(0) - zs;
+
+        seed = ~seed;
+    }
+
+    return value * F(32.69428253173828125f);
+}
+
+F simplex4(const NbParams& p, int seed, F x, F y, F z, F w) {
+    const float F4 = 0.309016994374947424f;
+    const float G4 = 0.138196601125010515f;
+    F s = (x + y + z + w) * F(F4);
+    I i = ffloor(x + s);
+    I j = ffloor(y + s);
+    I k = ffloor(z + s);
+    I l = ffloor(w + s);
+    F t = cvt(i + j + k + l) * F(G4);
+    F x0 = (x - cvt(i)) + t;
+    F y0 = (y - cvt(j)) + t;
+    F z0 = (z - cvt(k)) + t;
+    F w0 = (w - cvt(l)) + t;
+
+    // Axis ranks 0..3; masks are -1 where true.
+    I rx = I(0) - (as_i(x0 > y0) + as_i(x0 > z0) + as_i(x0 > w0));
+    I ry = I(0) - (as_i(y0 >= x0) + as_i(y0 > z0) + as_i(y0 > w0));
+    I rz = I(0) - (as_i(z0 >= x0) + as_i(z0 >= y0) + as_i(z0 > w0));
+    I rw = I(0) - (as_i(w0 >= x0) + as_i(w0 >= y0) + as_i(w0 >= z0));
+
+    i = i * I(PX);
+    j = j * I(PY);
+    k = k * I(PZ);
+    l = l * I(PW);
+
+    F zero(0.0f);
+    F n = zero;
+    for (int c = 0; c < 5; c++) {
+        I ox = sra(rx + I(c), 2);
+        I oy = sra(ry + I(c), 2);
+        I oz = sra(rz + I(c), 2);
+        I ow = sra(rw + I(c), 2);
+        F g(G4 * (float) c);
+        F xc = (x0 - cvt(ox)) + g;
+        F yc = (y0 - cvt(oy)) + g;
+        F zc = (z0 - cvt(oz)) + g;
+        F wc = (w0 - cvt(ow)) + g;
+        F a = (((F(0.6f) - xc * xc) - yc * yc) - zc * zc) - wc * wc;
+        F gr = grad4(p, seed, i + ox * I(PX), j + oy * I(PY), k + oz * I(PZ), l + ow * I(PW), xc, yc, zc, wc);
+        n = n + sel(a > zero, (a * a) * (a * a) * gr, zero);
+    }
+    return n * F(27.0f);
+}
+
+// Cellular (SingleCellular). Dist picks the distance formula; EuclideanSq uses Euclidean's and
+// only skips the square roots in cret.
+template <int Dist>
+inline F cdist2(F x, F y) {
+    if (Dist == NbCellManhattan) {
+        return fabs_(x) + fabs_(y);
+    }
+    if (Dist == NbCellHybrid) {
+        return (fabs_(x) + fabs_(y)) + (x * x + y * y);
+    }
+    return x * x + y * y;
+}
+
+template <int Dist>
+inline F cdist3(F x, F y, F z) {
+    if (Dist == NbCellManhattan) {
+        return fabs_(x) + fabs_(y) + fabs_(z);
+    }
+    if (Dist == NbCellHybrid) {
+        return (fabs_(x) + fabs_(y) + fabs_(z)) + (x * x + y * y + z * z);
+    }
+    return x * x + y * y + z * z;
+}
+
+// Folds one feature point into the nearest (d0, its hash ch) and second nearest (d1) distances.
+inline void cnear(F nd, I h, F& d0, F& d1, I& ch) {
+    d1 = max_(min_(d1, nd), d0);
+    M m = nd < d0;
+    d0 = sel(m, nd, d0);
+    ch = seli(m, h, ch);
+}
+
+inline F cret(const NbParams& p, F d0, F d1, I ch) {
+    if (p.cdist == NbCellEuclidean && p.cret >= NbCellDistance) {
+        d0 = sqrt_(d0);
+        if (p.cret >= NbCellDistance2) {
+            d1 = sqrt_(d1);
+        }
+    }
+    F one(1.0f);
+    switch (p.cret) {
+    case NbCellValue:
+        return cvt(ch) * F(1 / 2147483648.0f);
+    case NbCellDistance:
+        return d0 - one;
+    case NbCellDistance2:
+        return d1 - one;
+    case NbCellDistance2Add:
+        return (d1 + d0) * F(0.5f) - one;
+    case NbCellDistance2Sub:
+        return d1 - d0 - one;
+    case NbCellDistance2Mul:
+        return d1 * d0 * F(0.5f) - one;
+    case NbCellDistance2Div:
+        return d0 / d1 - one;
+    default:
+        return F(0.0f);
+    }
+}
+
+template <int Dist>
+F cellular2(const NbParams& p, int seed, F x, F y) {
+    I xr = fround(x);
+    I yr = fround(y);
+    F d0(1e10f);
+    F d1(1e10f);
+    I ch(0);
+    F cj(0.43701595f * p.cjit);
+    I xp = (xr - I(1)) * I(PX);
+    I yb = (yr - I(1)) * I(PY);
+    for (int a = -1; a <= 1; a++) {
+        F vx0 = cvt(xr + I(a)) - x;
+        I yp = yb;
+        for (int b = -1; b <= 1; b++) {
+            I h = hash2(seed, xp, yp);
+            I idx = h & I(255 << 1);
+            F vx = vx0 + gather(p.r2, idx) * cj;
+            F vy = (cvt(yr + I(b)) - y) + gather(p.r2, idx | I(1)) * cj;
+            cnear(cdist2<Dist>(vx, vy), h, d0, d1, ch);
+            yp = yp + I(PY);
+        }
+        xp = xp + I(PX);
+    }
+    return cret(p, d0, d1, ch);
+}
+
+template <int Dist>
+F cellular3(const NbParams& p, int seed, F x, F y, F z) {
+    I xr = fround(x);
+    I yr = fround(y);
+    I zr = fround(z);
+    F d0(1e10f);
+    F d1(1e10f);
+    I ch(0);
+    F cj(0.39614353f * p.cjit);
+    I xp = (xr - I(1)) * I(PX);
+    I yb = (yr - I(1)) * I(PY);
+    I zb = (zr - I(1)) * I(PZ);
+    for (int a = -1; a <= 1; a++) {
+        F vx0 = cvt(xr + I(a)) - x;
+        I yp = yb;
+        for (int b = -1; b <= 1; b++) {
+            F vy0 = cvt(yr + I(b)) - y;
+            I zp = zb;
+            for (int c = -1; c <= 1; c++) {
+                I h = hash3(seed, xp, yp, zp);
+                I idx = h & I(255 << 2);
+                F vx = vx0 + gather(p.r3, idx) * cj;
+                F vy = vy0 + gather(p.r3, idx | I(1)) * cj;
+                F vz = (cvt(zr + I(c)) - z) + gather(p.r3, idx | I(2)) * cj;
+                cnear(cdist3<Dist>(vx, vy, vz), h, d0, d1, ch);
+                zp = zp + I(PZ);
+            }
+            yp = yp + I(PY);
+        }
+        xp = xp + I(PX);
+    }
+    return cret(p, d0, d1, ch);
+}
+
+inline F pingpong(F t) {
+    I i = cvtt(t * F(0.5f));
+    t = t - cvt(i * I(2));
+    return sel(t < F(1.0f), t, F(2.0f) - t);
+}
+
+using K2 = F (*)(const NbParams&, int, F, F);
+using K3 = F (*)(const NbParams&, int, F, F, F);
+using K4 = F (*)(const NbParams&, int, F, F, F, F);
+
+template <int Fr, K2 Kern>
+F fract2(const NbParams& p, F x, F y) {
+    if (Fr == NbFractNone) {
+        return Kern(p, p.seed, x, y);
+    }
+    int seed = p.seed;
+    F sum(0.0f);
+    F amp(p.bound);
+    F one(1.0f);
+    F ws(p.wstr);
+    for (int o = 0; o < p.oct; o++) {
+        F n = Kern(p, seed++, x, y);
+        if (Fr == NbFractFBm) {
+            sum = sum + n * amp;
+            amp = amp * (one + ws * (min_(n + one, F(2.0f)) * F(0.5f) - one));
+        } else if (Fr == NbFractRidged) {
+            n = fabs_(n);
+            sum = sum + (n * F(-2.0f) + one) * amp;
+            amp = amp * (one + ws * ((one - n) - one));
+        } else {
+            n = pingpong((n + one) * F(p.pp));
+            sum = sum + (n - F(0.5f)) * F(2.0f) * amp;
+            amp = amp * (one + ws * (n - one));
+        }
+        x = x * F(p.lac);
+        y = y * F(p.lac);
+        amp = amp * F(p.gain);
+    }
+    return sum;
+}
+
+template <int Fr, K3 Kern>
+F fract3(const NbParams& p, F x, F y, F z) {
+    if (Fr == NbFractNone) {
+        return Kern(p, p.seed, x, y, z);
+    }
+    int seed = p.seed;
+    F sum(0.0f);
+    F amp(p.bound);
+    F one(1.0f);
+    F ws(p.wstr);
+    for (int o = 0; o < p.oct; o++) {
+        F n = Kern(p, seed++, x, y, z);
+        if (Fr == NbFractFBm) {
+            sum = sum + n * amp;
+            amp = amp * (one + ws * ((n + one) * F(0.5f) - one));
+        } else if (Fr == NbFractRidged) {
+            n = fabs_(n);
+            sum = sum + (n * F(-2.0f) + one) * amp;
+            amp = amp * (one + ws * ((one - n) - one));
+        } else {
+            n = pingpong((n + one) * F(p.pp));
+            sum = sum + (n - F(0.5f)) * F(2.0f) * amp;
+            amp = amp * (one + ws * (n - one));
+        }
+        x = x * F(p.lac);
+        y = y * F(p.lac);
+        z = z * F(p.lac);
+        amp = amp * F(p.gain);
+    }
+    return sum;
+}
+
+template <int Fr, K4 Kern>
+F fract4(const NbParams& p, F x, F y, F z, F w) {
+    if (Fr == NbFractNone) {
+        return Kern(p, p.seed, x, y, z, w);
+    }
+    int seed = p.seed;
+    F sum(0.0f);
+    F amp(p.bound);
+    F one(1.0f);
+    F ws(p.wstr);
+    for (int o = 0; o < p.oct; o++) {
+        F n = Kern(p, seed++, x, y, z, w);
+        if (Fr == NbFractFBm) {
+            sum = sum + n * amp;
+            amp = amp * (one + ws * ((n + one) * F(0.5f) - one));
+        } else if (Fr == NbFractRidged) {
+            n = fabs_(n);
+            sum = sum + (n * F(-2.0f) + one) * amp;
+            amp = amp * (one + ws * ((one - n) - one));
+        } else {
+            n = pingpong((n + one) * F(p.pp));
+            sum = sum + (n - F(0.5f)) * F(2.0f) * amp;
+            amp = amp * (one + ws * (n - one));
+        }
+        x = x * F(p.lac);
+        y = y * F(p.lac);
+        z = z * F(p.lac);
+        w = w * F(p.lac);
+        amp = amp * F(p.gain);
+    }
+    return sum;
+}
+
+template <int Fr, K2 Kern>
+void loop2(const NbParams& p, const float* xs, const float* ys, float* out, int n) {
+    const float SQRT3 = (float) 1.7320508075688772935274463415059;
+    const float F2 = 0.5f * (SQRT3 - 1);
+    F fq(p.freq);
+    for (int i = 0; i < n; i += W) {
+        int m = n - i < W ? n - i : W;
+        F x = load(xs + i, m) * fq;
+        F y = load(ys + i, m) * fq;
+        if (p.type == NbOpenSimplex2) {
+            F t = (x + y) * F(F2);
+            x = x + t;
+            y = y + t;
+        }
+        store(out + i, fract2<Fr, Kern>(p, x, y), m);
+    }
+}
+
+template <int Fr, K3 Kern>
+void loop3(const NbParams& p, const float* xs, const float* ys, const float* zs, float* out, int n) {
+    F fq(p.freq);
+    F c1(-(float) 0.211324865405187);
+    F c2((float) 0.577350269189626);
+    for (int i = 0; i < n; i += W) {
+        int m = n - i < W ? n - i : W;
+        F x = load(xs + i, m) * fq;
+        F y = load(ys + i, m) * fq;
+        F z = load(zs + i, m) * fq;
+        if (p.xf3 == NbXfImproveXY) {
+            F xy = x + y;
+            F s2 = xy * c1;
+            z = z * c2;
+            x = x + (s2 - z);
+            y = y + s2 - z;
+            z = z + xy * c2;
+        } else if (p.xf3 == NbXfImproveXZ) {
+            F xz = x + z;
+            F s2 = xz * c1;
+            y = y * c2;
+            x = x + (s2 - y);
+            z = z + (s2 - y);
+            y = y + xz * c2;
+        } else if (p.xf3 == NbXfOpenSimplex2) {
+            F r = (x + y + z) * F((float) (2.0 / 3.0));
+            x = r - x;
+            y = r - y;
+            z = r - z;
+        }
+        store(out + i, fract3<Fr, Kern>(p, x, y, z), m);
+    }
+}
+
+template <int Fr, K4 Kern>
+void loop4(const NbParams& p, const float* xs, const float* ys, const float* zs, const float* ws, float* out, int n) {
+    F fq(p.freq);
+    for (int i = 0; i < n; i += W) {
+        int m = n - i < W ? n - i : W;
+        F x = load(xs + i, m) * fq;
+        F y = load(ys + i, m) * fq;
+        F z = load(zs + i, m) * fq;
+        F w = load(ws + i, m) * fq;
+        store(out + i, fract4<Fr, Kern>(p, x, y, z, w), m);
+    }
+}
+
+template <K2 Kern>
+void run2_k(const NbParams& p, const float* xs, const float* ys, float* out, int n) {
+    switch (p.fract) {
+    case NbFractFBm:
+        loop2<NbFractFBm, Kern>(p, xs, ys, out, n);
+        break;
+    case NbFractRidged:
+        loop2<NbFractRidged, Kern>(p, xs, ys, out, n);
+        break;
+    case NbFractPingPong:
+        loop2<NbFractPingPong, Kern>(p, xs, ys, out, n);
+        break;
+    default:
+        loop2<NbFractNone, Kern>(p, xs, ys, out, n);
+        break;
+    }
+}
+
+template <K3 Kern>
+void run3_k(const NbParams& p, const float* xs, const float* ys, const float* zs, float* out, int n) {
+    switch (p.fract) {
+    case NbFractFBm:
+        loop3<NbFractFBm, Kern>(p, xs, ys, zs, out, n);
+        break;
+    case NbFractRidged:
+        loop3<NbFractRidged, Kern>(p, xs, ys, zs, out, n);
+        break;
+    case NbFractPingPong:
+        loop3<NbFractPingPong, Kern>(p, xs, ys, zs, out, n);
+        break;
+    default:
+        loop3<NbFractNone, Kern>(p, xs, ys, zs, out, n);
+        break;
+    }
+}
+
+void run2(const NbParams& p, const float* xs, const float* ys, float* out, int n) {
+    switch (p.type) {
+    case NbOpenSimplex2:
+        run2_k<simplex2>(p, xs, ys, out, n);
+        break;
+    case NbPerlin:
+        run2_k<perlin2>(p, xs, ys, out, n);
+        break;
+    case NbValueCubic:
+        run2_k<vcubic2>(p, xs, ys, out, n);
+        break;
+    case NbCellular:
+        if (p.cdist == NbCellManhattan) {
+            run2_k<cellular2<NbCellManhattan>>(p, xs, ys, out, n);
+        } else if (p.cdist == NbCellHybrid) {
+            run2_k<cellular2<NbCellHybrid>>(p, xs, ys, out, n);
+        } else {
+            run2_k<cellular2<NbCellEuclidean>>(p, xs, ys, out, n);
+        }
+        break;
+    default:
+        run2_k<value2>(p, xs, ys, out, n);
+        break;
+    }
+}
+
+void run3(const NbParams& p, const float* xs, const float* ys, const float* zs, float* out, int n) {
+    switch (p.type) {
+    case NbOpenSimplex2:
+        run3_k<simplex3>(p, xs, ys, zs, out, n);
+        break;
+    case NbPerlin:
+        run3_k<perlin3>(p, xs, ys, zs, out, n);
+        break;
+    case NbValueCubic:
+        run3_k<vcubic3>(p, xs, ys, zs, out, n);
+        break;
+    case NbCellular:
+        if (p.cdist == NbCellManhattan) {
+            run3_k<cellular3<NbCellManhattan>>(p, xs, ys, zs, out, n);
+        } else if (p.cdist == NbCellHybrid) {
+            run3_k<cellular3<NbCellHybrid>>(p, xs, ys, zs, out, n);
+        } else {
+            run3_k<cellular3<NbCellEuclidean>>(p, xs, ys, zs, out, n);
+        }
+        break;
+    default:
+        run3_k<value3>(p, xs, ys, zs, out, n);
+        break;
+    }
+}
+
+template <K4 Kern>
+void run4_k(const NbParams& p, const float* xs, const float* ys, const float* zs, const float* ws, float* out, int n) {
+    switch (p.fract) {
+    case NbFractFBm:
+        loop4<NbFractFBm, Kern>(p, xs, ys, zs, ws, out, n);
+        break;
+    case NbFractRidged:
+        loop4<NbFractRidged, Kern>(p, xs, ys, zs, ws, out, n);
+        break;
+    case NbFractPingPong:
+        loop4<NbFractPingPong, Kern>(p, xs, ys, zs, ws, out, n);
+        break;
+    default:
+        loop4<NbFractNone, Kern>(p, xs, ys, zs, ws, out, n);
+        break;
+    }
+}
+
+void run4(const NbParams& p, const float* xs, const float* ys, const float* zs, const float* ws, float* out, int n) {
+    switch (p.type) {
+    case NbOpenSimplex2:
+        run4_k<simplex4>(p, xs, ys, zs, ws, out, n);
+        break;
+    case NbPerlin:
+        run4_k<perlin4>(p, xs, ys, zs, ws, out, n);
+        break;
+    default:
+        run4_k<value4>(p, xs, ys, zs, ws, out, n);
+        break;
+    }
+}
+
+// One octave of the 2D domain warp (SingleDomainWarpSimplexGradient / BasicGrid): both
+// displacement components from one lattice walk. p.amp already holds the type's scale.
+template <bool Out>
+inline void wgrad2(const NbParams& p, I x, I y, F xd, F yd, F& xo, F& yo) {
+    if (Out) {
+        gout2(p, p.seed, x, y, xo, yo);
+    } else {
+        gdual2(p, p.seed, x, y, xd, yd, xo, yo);
+    }
+}
+
+template <bool Out>
+void warp_simplex(const NbParams& p, F x, F y, F& dx, F& dy) {
+    const float SQRT3 = (float) 1.7320508075688772935274463415059;
+    const float F2 = 0.5f * (SQRT3 - 1);
+    const float G2 = (3 - SQRT3) / 6;
+    F s = (x + y) * F(F2);
+    x = (x + s) * F(p.freq);
+    y = (y + s) * F(p.freq);
+    I i = ffloor(x);
+    I j = ffloor(y);
+    F xi = x - cvt(i);
+    F yi = y - cvt(j);
+    F t = (xi + yi) * F(G2);
+    F x0 = xi - t;
+    F y0 = yi - t;
+    i = i * I(PX);
+    j = j * I(PY);
+    F zero(0.0f);
+    F xo, yo;
+
+    F a = F(0.5f) - x0 * x0 - y0 * y0;
+    wgrad2<Out>(p, i, j, x0, y0, xo, yo);
+    M ma = a > zero;
+    F aaaa = (a * a) * (a * a);
+    F vx = zero + sel(ma, aaaa * xo, zero);
+    F vy = zero + sel(ma, aaaa * yo, zero);
+
+    F c = F((float) (2 * (1 - 2 * G2) * (1 / G2 - 2))) * t + (F((float) (-2 * (1 - 2 * G2) * (1 - 2 * G2))) + a);
+    F x2 = x0 + F(2 * (float) G2 - 1);
+    F y2 = y0 + F(2 * (float) G2 - 1);
+    wgrad2<Out>(p, i + I(PX), j + I(PY), x2, y2, xo, yo);
+    M mc = c > zero;
+    F cccc = (c * c) * (c * c);
+    vx = vx + sel(mc, cccc * xo, zero);
+    vy = vy + sel(mc, cccc * yo, zero);
+
+    M up = y0 > x0;
+    F x1 = sel(up, x0 + F((float) G2), x0 + F((float) G2 - 1));
+    F y1 = sel(up, y0 + F((float) G2 - 1), y0 + F((float) G2));
+    F b = F(0.5f) - x1 * x1 - y1 * y1;
+    wgrad2<Out>(p, seli(up, i, i + I(PX)), seli(up, j + I(PY), j), x1, y1, xo, yo);
+    M mb = b > zero;
+    F bbbb = (b * b) * (b * b);
+    vx = vx + sel(mb, bbbb * xo, zero);
+    vy = vy + sel(mb, bbbb * yo, zero);
+
+    dx = zero + vx * F(p.amp);
+    dy = zero + vy * F(p.amp);
+}
+
+void warp_grid(const NbParams& p, F x, F y, F& dx, F& dy) {
+    F xf = x * F(p.freq);
+    F yf = y * F(p.freq);
+    I x0 = ffloor(xf);
+    I y0 = ffloor(yf);
+    F xs = hermite(xf - cvt(x0));
+    F ys = hermite(yf - cvt(y0));
+    x0 = x0 * I(PX);
+    y0 = y0 * I(PY);
+    I x1 = x0 + I(PX);
+    I y1 = y0 + I(PY);
+
+    I h0 = hash2(p.seed, x0, y0) & I(255 << 1);
+    I h1 = hash2(p.seed, x1, y0) & I(255 << 1);
+    F lx0x = lerp(gather(p.r2, h0), gather(p.r2, h1), xs);
+    F ly0x = lerp(gather(p.r2, h0 | I(1)), gather(p.r2, h1 | I(1)), xs);
+
+    h0 = hash2(p.seed, x0, y1) & I(255 << 1);
+    h1 = hash2(p.seed, x1, y1) & I(255 << 1);
+    F lx1x = lerp(gather(p.r2, h0), gather(p.r2, h1), xs);
+    F ly1x = lerp(gather(p.r2, h0 | I(1)), gather(p.r2, h1 | I(1)), xs);
+
+    F zero(0.0f);
+    dx = zero + lerp(lx0x, lx1x, ys) * F(p.amp);
+    dy = zero + lerp(ly0x, ly1x, ys) * F(p.amp);
+}
+
+using KW = void (*)(const NbParams&, F, F, F&, F&);
+
+template <KW Kern>
+void loopw(const NbParams& p, const float* xs, const float* ys, float* dx, float* dy, int n) {
+    for (int i = 0; i < n; i += W) {
+        int m = n - i < W ? n - i : W;
+        F ox, oy;
+        Kern(p, load(xs + i, m), load(ys + i, m), ox, oy);
+        store(dx + i, ox, m);
+        store(dy + i, oy, m);
+    }
+}
+
+void runw(const NbParams& p, const float* xs, const float* ys, float* dx, float* dy, int n) {
+    switch (p.type) {
+    case NbWarpOpenSimplex2:
+        loopw<warp_simplex<false>>(p, xs, ys, dx, dy, n);
+        break;
+    case NbWarpOpenSimplex2Reduced:
+        loopw<warp_simplex<true>>(p, xs, ys, dx, dy, n);
+        break;
+    default:
+        loopw<warp_grid>(p, xs, ys, dx, dy, n);
+        break;
+    }
+}
+
+// Scanline evaluation of rows whose y (and z) is the same for every pixel. Per octave, the
+// pixels are split into runs that share a lattice cell; a cell's corner hashes and gradients
+// are computed once (as broadcasts) and its pixels are then swept a vector at a time. Every
+// lane goes through the same operations as the per-pixel kernels, so results are identical.
+
+inline int sfloor(float f) {
+    return f >= 0 ? (int) f : (int) f - 1;
+}
+
+using S2 = void (*)(const NbParams&, int, const float*, int, int, float, float*);
+using S3 = void (*)(const NbParams&, int, const float*, int, int, float, float, float*);
+
+void cell_perlin2(const NbParams& p, int seed, const float* xs, int n, int k, float y, float* out) {
+    F yv(y);
+    I y0 = ffloor(yv);
+    F yd0 = yv - cvt(y0);
+    F yd1 = yd0 - F(1.0f);
+    F ys = quintic(yd0);
+    I x0 = I(k) * I(PX);
+    I x1 = x0 + I(PX);
+    y0 = y0 * I(PY);
+    I y1 = y0 + I(PY);
+    F g00, g10, g01, g11, h;
+    gvec2(p, seed, x0, y0, g00, h);
+    F c00 = yd0 * h;
+    gvec2(p, seed, x1, y0, g10, h);
+    F c10 = yd0 * h;
+    gvec2(p, seed, x0, y1, g01, h);
+    F c01 = yd1 * h;
+    gvec2(p, seed, x1, y1, g11, h);
+    F c11 = yd1 * h;
+    F kf = cvt(I(k));
+    for (int i = 0; i < n; i += W) {
+        F xd0 = load(xs + i, W) - kf;
+        F xd1 = xd0 - F(1.0f);
+        F t = quintic(xd0);
+        F xf0 = lerp(xd0 * g00 + c00, xd1 * g10 + c10, t);
+        F xf1 = lerp(xd0 * g01 + c01, xd1 * g11 + c11, t);
+        store(out + i, lerp(xf0, xf1, ys) * F(1.4247691104677813f), W);
+    }
+}
+
+void cell_perlin3(const NbParams& p, int seed, const float* xs, int n, int k, float y, float z, float* out) {
+    F yv(y);
+    F zv(z);
+    I y0 = ffloor(yv);
+    I z0 = ffloor(zv);
+    F yd[2], zd[2];
+    yd[0] = yv - cvt(y0);
+    zd[0] = zv - cvt(z0);
+    yd[1] = yd[0] - F(1.0f);
+    zd[1] = zd[0] - F(1.0f);
+    F ys = quintic(yd[0]);
+    F zs = quintic(zd[0]);
+    I xp[2] = {I(k) * I(PX), I(k) * I(PX) + I(PX)};
+    I yp[2] = {y0 * I(PY), y0 * I(PY) + I(PY)};
+    I zp[2] = {z0 * I(PZ), z0 * I(PZ) + I(PZ)};
+    // [x][y][z] corner: x gradient, y and z terms of the dot product.
+    F g[2][2][2], cy[2][2][2], cz[2][2][2];
+    for (int a = 0; a < 2; a++) {
+        for (int b = 0; b < 2; b++) {
+            for (int c = 0; c < 2; c++) {
+                F yg, zg;
+                gvec3(p, seed, xp[a], yp[b], zp[c], g[a][b][c], yg, zg);
+                cy[a][b][c] = yd[b] * yg;
+                cz[a][b][c] = zd[c] * zg;
+            }
+        }
+    }
+    F kf = cvt(I(k));
+    for (int i = 0; i < n; i += W) {
+        F xd0 = load(xs + i, W) - kf;
+        F xd1 = xd0 - F(1.0f);
+        F t = quintic(xd0);
+        F xf[2][2];
+        for (int b = 0; b < 2; b++) {
+            for (int c = 0; c < 2; c++) {
+                F v0 = xd0 * g[0][b][c] + cy[0][b][c] + cz[0][b][c];
+                F v1 = xd1 * g[1][b][c] + cy[1][b][c] + cz[1][b][c];
+                xf[b][c] = lerp(v0, v1, t);
+            }
+        }
+        F yf0 = lerp(xf[0][0], xf[1][0], ys);
+        F yf1 = lerp(xf[0][1], xf[1][1], ys);
+        store(out + i, lerp(yf0, yf1, zs) * F(0.964921414852142333984375f), W);
+    }
+}
+
+void cell_value2(const NbParams&, int seed, const float* xs, int n, int k, float y, float* out) {
+    F yv(y);
+    I y0 = ffloor(yv);
+    F ys = hermite(yv - cvt(y0));
+    I x0 = I(k) * I(PX);
+    I x1 = x0 + I(PX);
+    y0 = y0 * I(PY);
+    I y1 = y0 + I(PY);
+    F v00 = valc2(seed, x0, y0);
+    F v10 = valc2(seed, x1, y0);
+    F v01 = valc2(seed, x0, y1);
+    F v11 = valc2(seed, x1, y1);
+    F kf = cvt(I(k));
+    for (int i = 0; i < n; i += W) {
+        F t = hermite(load(xs + i, W) - kf);
+        store(out + i, lerp(lerp(v00, v10, t), lerp(v01, v11, t), ys), W);
+    }
+}
+
+void cell_value3(const NbParams&, int seed, const float* xs, int n, int k, float y, float z, float* out) {
+    F yv(y);
+    F zv(z);
+    I y0 = ffloor(yv);
+    I z0 = ffloor(zv);
+    F ys = hermite(yv - cvt(y0));
+    F zs = hermite(zv - cvt(z0));
+    I x0 = I(k) * I(PX);
+    I x1 = x0 + I(PX);
+    y0 = y0 * I(PY);
+    z0 = z0 * I(PZ);
+    I y1 = y0 + I(PY);
+    I z1 = z0 + I(PZ);
+    F v000 = valc3(seed, x0, y0, z0);
+    F v100 = valc3(seed, x1, y0, z0);
+    F v010 = valc3(seed, x0, y1, z0);
+    F v110 = valc3(seed, x1, y1, z0);
+    F v001 = valc3(seed, x0, y0, z1);
+    F v101 = valc3(seed, x1, y0, z1);
+    F v011 = valc3(seed, x0, y1, z1);
+    F v111 = valc3(seed, x1, y1, z1);
+    F kf = cvt(I(k));
+    for (int i = 0; i < n; i += W) {
+        F t = hermite(load(xs + i, W) - kf);
+        F yf0 = lerp(lerp(v000, v100, t), lerp(v010, v110, t), ys);
+        F yf1 = lerp(lerp(v001, v101, t), lerp(v011, v111, t), ys);
+        store(out + i, lerp(yf0, yf1, zs), W);
+    }
+}
+
+void cell_cubic2(const NbParams&, int seed, const float* xs, int n, int k, float y, float* out) {
+    F yv(y);
+    I y1 = ffloor(yv);
+    F ys = yv - cvt(y1);
+    I x1 = I(k) * I(PX);
+    y1 = y1 * I(PY);
+    I yp[4] = {y1 - I(PY), y1, y1 + I(PY), y1 + I(PY2)};
+    I xp[4] = {x1 - I(PX), x1, x1 + I(PX), x1 + I(PX2)};
+    F v[4][4];
+    for (int b = 0; b < 4; b++) {
+        for (int a = 0; a < 4; a++) {
+            v[b][a] = valc2(seed, xp[a], yp[b]);
+        }
+    }
+    F kf = cvt(I(k));
+    for (int i = 0; i < n; i += W) {
+        F t = load(xs + i, W) - kf;
+        F r[4];
+        for (int b = 0; b < 4; b++) {
+            r[b] = cubic(v[b][0], v[b][1], v[b][2], v[b][3], t);
+        }
+        store(out + i, cubic(r[0], r[1], r[2], r[3], ys) * F(1 / (1.5f * 1.5f)), W);
+    }
+}
+
+void cell_cubic3(const NbParams&, int seed, const float* xs, int n, int k, float y, float z, float* out) {
+    F yv(y);
+    F zv(z);
+    I y1 = ffloor(yv);
+    I z1 = ffloor(zv);
+    F ys = yv - cvt(y1);
+    F zs = zv - cvt(z1);
+    I x1 = I(k) * I(PX);
+    y1 = y1 * I(PY);
+    z1 = z1 * I(PZ);
+    I xp[4] = {x1 - I(PX), x1, x1 + I(PX), x1 + I(PX2)};
+    I yp[4] = {y1 - I(PY), y1, y1 + I(PY), y1 + I(PY2)};
+    I zp[4] = {z1 - I(PZ), z1, z1 + I(PZ), z1 + I(PZ2)};
+    F v[4][4][4];
+    for (int c = 0; c < 4; c++) {
+        for (int b = 0; b < 4; b++) {
+            for (int a = 0; a < 4; a++) {
+                v[c][b][a] = valc3(seed, xp[a], yp[b], zp[c]);
+            }
+        }
+    }
+    F kf = cvt(I(k));
+    for (int i = 0; i < n; i += W) {
+        F t = load(xs + i, W) - kf;
+        F zf[4];
+        for (int c = 0; c < 4; c++) {
+            F r[4];
+            for (int b = 0; b < 4; b++) {
+                r[b] = cubic(v[c][b][0], v[c][b][1], v[c][b][2], v[c][b][3], t);
+            }
+            zf[c] = cubic(r[0], r[1], r[2], r[3], ys);
+        }
+        store(out + i, cubic(zf[0], zf[1], zf[2], zf[3], zs) * F(1 / (1.5f * 1.5f * 1.5f)), W);
+    }
+}
+
+// Runs are keyed by the cell the kernel starts from: the floor of x, or for Cellular (Rnd)
+// the rounded x.
+inline int sround(float f) {
+    return f >= 0 ? (int) (f + 0.5f) : (int) (f - 0.5f);
+}
+
+template <bool Rnd>
+inline int skey(float f) {
+    return Rnd ? sround(f) : sfloor(f);
+}
+
+template <bool Rnd>
+inline I vkey(F f) {
+    return Rnd ? fround(f) : ffloor(f);
+}
+
+// Cells narrower than CW vectors are cheaper per pixel: fall back to the lane kernel.
+constexpr int CW = 2;
+
+inline void xrange(const float* x, int n, float& lo, float& hi) {
+    F vlo(x[0]);
+    F vhi(x[0]);
+    int i = 0;
+    for (; i + W <= n; i += W) {
+        F v = load(x + i, W);
+        vlo = min_(vlo, v);
+        vhi = max_(vhi, v);
+    }
+    alignas(32) float l[W], h[W];
+    store(l, vlo, W);
+    store(h, vhi, W);
+    lo = x[0];
+    hi = x[0];
+    for (int j = 0; j < W; j++) {
+        lo = l[j] < lo ? l[j] : lo;
+        hi = h[j] > hi ? h[j] : hi;
+    }
+    for (; i < n; i++) {
+        lo = x[i] < lo ? x[i] : lo;
+        hi = x[i] > hi ? x[i] : hi;
+    }
+}
+
+// Key range [k0, k1] of x[0, n); true when the cells are wide enough to scan.
+template <bool Rnd>
+inline bool cell_span(const float* x, int n, int& k0, int& k1) {
+    float lo, hi;
+    xrange(x, n, lo, hi);
+    k0 = skey<Rnd>(lo);
+    k1 = skey<Rnd>(hi);
+    return ((long long) k1 - k0 + 1) * W * CW <= (long long) n;
+}
+
+// Whether the first (widest) octave of a row is coarse enough to be worth scanning.
+inline bool scan_worth(const NbParams& p, const float* xs, int n) {
+    float lo, hi;
+    xrange(xs, n, lo, hi);
+    float span = (hi - lo) * (p.freq < 0 ? -p.freq : p.freq);
+    return (span + 2.0f) * (float) (W * CW) <= (float) n;
+}
+
+// End of the run of pixels from i on that lie in cell k; whole vectors are tested at once.
+template <bool Rnd>
+inline int cell_end(const float* x, int i, int n, int k) {
+    int j = i + 1;
+    I kv(k);
+    while (j + W <= n && all_eq(vkey<Rnd>(load(x + j, W)), kv)) {
+        j += W;
+    }
+    while (j < n && skey<Rnd>(x[j]) == k) {
+        j++;
+    }
+    return j;
+}
+
+// One octave over a chunk; x and out have W floats of slack past n: runs are swept in whole
+// vectors and the lanes past a run's end are overwritten by the next run.
+using O2 = void (*)(const NbParams&, int, const float*, int, float, float*);
+using O3 = void (*)(const NbParams&, int, const float*, int, float, float, float*);
+
+template <S2 Cell, K2 Kern>
+void octave2(const NbParams& p, int seed, const float* x, int n, float y, float* out) {
+    int k0, k1;
+    if (!cell_span<false>(x, n, k0, k1)) {
+        F yv(y);
+        for (int i = 0; i < n; i += W) {
+            store(out + i, Kern(p, seed, load(x + i, W), yv), W);
+        }
+        return;
+    }
+    for (int i = 0; i < n;) {
+        int k = sfloor(x[i]);
+        int j = cell_end<false>(x, i, n, k);
+        Cell(p, seed, x + i, j - i, k, y, out + i);
+        i = j;
+    }
+}
+
+template <S3 Cell, K3 Kern>
+void octave3(const NbParams& p, int seed, const float* x, int n, float y, float z, float* out) {
+    int k0, k1;
+    if (!cell_span<false>(x, n, k0, k1)) {
+        F yv(y);
+        F zv(z);
+        for (int i = 0; i < n; i += W) {
+            store(out + i, Kern(p, seed, load(x + i, W), yv, zv), W);
+        }
+        return;
+    }
+    for (int i = 0; i < n;) {
+        int k = sfloor(x[i]);
+        int j = cell_end<false>(x, i, n, k);
+        Cell(p, seed, x + i, j - i, k, y, z, out + i);
+        i = j;
+    }
+}
+
+constexpr int SCH = 256;
+
+// Cellular feature points of the cells a scanned chunk can reach, generated once per octave:
+// column c is x cell c0 + c, row r is the (y, z) neighbour (3 rows in 2D, 9 in 3D). Per point
+// it keeps the x jitter, the point's full y/z offset from the row and its hash, so a pixel
+// only adds its own x. Wide chunks (cell_span) need at most GC columns.
+constexpr int GC = SCH / (W * CW) + 3;
+
+struct CGrid {
+    int c0;
+    float jx[9][GC];
+    float vy[9][GC];
+    float vz[9][GC];
+    int h[9][GC];
+};
+
+inline int chash(int seed, unsigned x, unsigned y, unsigned z) {
+    return (int) (((unsigned) seed ^ x ^ y ^ z) * 0x27d4eb2du);
+}
+
+void cgrid2(const NbParams& p, int seed, int k0, int k1, float y, CGrid& g) {
+    int yr = sround(y);
+    float cj = 0.43701595f * p.cjit;
+    g.c0 = k0 - 1;
+    for (int b = 0; b < 3; b++) {
+        unsigned yp = (unsigned) (yr - 1 + b) * (unsigned) PY;
+        float vy0 = (float) (yr - 1 + b) - y;
+        for (int c = 0; c < k1 - k0 + 3; c++) {
+            int h = chash(seed, (unsigned) (g.c0 + c) * (unsigned) PX, yp, 0u);
+            int idx = h & (255 << 1);
+            g.jx[b][c] = p.r2[idx] * cj;
+            g.vy[b][c] = vy0 + p.r2[idx | 1] * cj;
+            g.h[b][c] = h;
+        }
+    }
+}
+
+void cgrid3(const NbParams& p, int seed, int k0, int k1, float y, float z, CGrid& g) {
+    int yr = sround(y);
+    int zr = sround(z);
+    float cj = 0.39614353f * p.cjit;
+    g.c0 = k0 - 1;
+    for (int b = 0; b < 3; b++) {
+        for (int d = 0; d < 3; d++) {
+            int r = b * 3 + d;
+            unsigned yp = (unsigned) (yr - 1 + b) * (unsigned) PY;
+            unsigned zp = (unsigned) (zr - 1 + d) * (unsigned) PZ;
+            float vy0 = (float) (yr - 1 + b) - y;
+            float vz0 = (float) (zr - 1 + d) - z;
+            for (int c = 0; c < k1 - k0 + 3; c++) {
+                int h = chash(seed, (unsigned) (g.c0 + c) * (unsigned) PX, yp, zp);
+                int idx = h & (255 << 2);
+                g.jx[r][c] = p.r3[idx] * cj;
+                g.vy[r][c] = vy0 + p.r3[idx | 1] * cj;
+                g.vz[r][c] = vz0 + p.r3[idx | 2] * cj;
+                g.h[r][c] = h;
+            }
+        }
+    }
+}
+
+// Pixels whose nearest cell is x cell k, in cellular2's order of neighbours.
+template <int Dist>
+void crun2(const NbParams& p, const CGrid& g, const float* xs, int n, int k, float* out) {
+    int c = k - 1 - g.c0;
+    F fx[3];
+    for (int a = 0; a < 3; a++) {
+        fx[a] = cvt(I(k - 1 + a));
+    }
+    for (int i = 0; i < n; i += W) {
+        F x = load(xs + i, W);
+        F d0(1e10f);
+        F d1(1e10f);
+        I ch(0);
+        for (int a = 0; a < 3; a++) {
+            F vx0 = fx[a] - x;
+            for (int b = 0; b < 3; b++) {
+                F vx = vx0 + F(g.jx[b][c + a]);
+                cnear(cdist2<Dist>(vx, F(g.vy[b][c + a])), I(g.h[b][c + a]), d0, d1, ch);
+            }
+        }
+        store(out + i, cret(p, d0, d1, ch), W);
+    }
+}
+
+template <int Dist>
+void crun3(const NbParams& p, const CGrid& g, const float* xs, int n, int k, float* out) {
+    int c = k - 1 - g.c0;
+    F fx[3];
+    for (int a = 0; a < 3; a++) {
+        fx[a] = cvt(I(k - 1 + a));
+    }
+    for (int i = 0; i < n; i += W) {
+        F x = load(xs + i, W);
+        F d0(1e10f);
+        F d1(1e10f);
+        I ch(0);
+        for (int a = 0; a < 3; a++) {
+            F vx0 = fx[a] - x;
+            for (int r = 0; r < 9; r++) {
+                F vx = vx0 + F(g.jx[r][c + a]);
+                F nd = cdist3<Dist>(vx, F(g.vy[r][c + a]), F(g.vz[r][c + a]));
+                cnear(nd, I(g.h[r][c + a]), d0, d1, ch);
+            }
+        }
+        store(out + i, cret(p, d0, d1, ch), W);
+    }
+}
+
+template <int Dist>
+void coctave2(const NbParams& p, int seed, const float* x, int n, float y, float* out) {
+    int k0, k1;
+    if (!cell_span<true>(x, n, k0, k1)) {
+        F yv(y);
+        for (int i = 0; i < n; i += W) {
+            store(out + i, cellular2<Dist>(p, seed, load(x + i, W), yv), W);
+        }
+        return;
+    }
+    CGrid g;
+    cgrid2(p, seed, k0, k1, y, g);
+    for (int i = 0; i < n;) {
+        int k = sround(x[i]);
+        int j = cell_end<true>(x, i, n, k);
+        crun2<Dist>(p, g, x + i, j - i, k, out + i);
+        i = j;
+    }
+}
+
+template <int Dist>
+void coctave3(const NbParams& p, int seed, const float* x, int n, float y, float z, float* out) {
+    int k0, k1;
+    if (!cell_span<true>(x, n, k0, k1)) {
+        F yv(y);
+        F zv(z);
+        for (int i = 0; i < n; i += W) {
+            store(out + i, cellular3<Dist>(p, seed, load(x + i, W), yv, zv), W);
+        }
+        return;
+    }
+    CGrid g;
+    cgrid3(p, seed, k0, k1, y, z, g);
+    for (int i = 0; i < n;) {
+        int k = sround(x[i]);
+        int j = cell_end<true>(x, i, n, k);
+        crun3<Dist>(p, g, x + i, j - i, k, out + i);
+        i = j;
+    }
+}
+
+// One fractal step over a run of octave values, as fract2 (D3 false) / fract3 do per lane.
+// Also advances x to the next octave's frequency.
+template <int Fr, bool D3>
+void accum(const NbParams& p, const float* nz, float* x, float* sum, float* amp, int n) {
+    F one(1.0f);
+    F ws(p.wstr);
+    F lac(p.lac);
+    for (int i = 0; i < n; i += W) {
+        F v = load(nz + i, W);
+        F s = load(sum + i, W);
+        F a = load(amp + i, W);
+        if (Fr == NbFractFBm) {
+            s = s + v * a;
+            F h = D3 ? v + one : min_(v + one, F(2.0f));
+            a = a * (one + ws * (h * F(0.5f) - one));
+        } else if (Fr == NbFractRidged) {
+            v = fabs_(v);
+            s = s + (v * F(-2.0f) + one) * a;
+            a = a * (one + ws * ((one - v) - one));
+        } else {
+            v = pingpong((v + one) * F(p.pp));
+            s = s + (v - F(0.5f)) * F(2.0f) * a;
+            a = a * (one + ws * (v - one));
+        }
+        store(sum + i, s, W);
+        store(amp + i, a * F(p.gain), W);
+        store(x + i, load(x + i, W) * lac, W);
+    }
+}
+
+template <int Fr, O2 Oct>
+void scan2_f(const NbParams& p, const float* xs, float y, float* out, int n) {
+    float xf[SCH + W] = {}, nz[SCH + W], sum[SCH + W], amp[SCH + W];
+    int oct = Fr == NbFractNone ? 1 : p.oct;
+    for (int c0 = 0; c0 < n; c0 += SCH) {
+        int cn = n - c0 < SCH ? n - c0 : SCH;
+        float yf = y * p.freq;
+        for (int i = 0; i < cn; i++) {
+            xf[i] = xs[c0 + i] * p.freq;
+            sum[i] = 0.0f;
+            amp[i] = p.bound;
+        }
+        int seed = p.seed;
+        for (int o = 0; o < oct; o++) {
+            Oct(p, seed++, xf, cn, yf, nz);
+            if (Fr == NbFractNone) {
+                break;
+            }
+            accum<Fr, false>(p, nz, xf, sum, amp, cn);
+            yf *= p.lac;
+        }
+        std::memcpy(out + c0, Fr == NbFractNone ? nz : sum, sizeof(float) * (size_t) cn);
+    }
+}
+
+template <int Fr, O3 Oct>
+void scan3_f(const NbParams& p, const float* xs, float y, float z, float* out, int n) {
+    float xf[SCH + W] = {}, nz[SCH + W], sum[SCH + W], amp[SCH + W];
+    int oct = Fr == NbFractNone ? 1 : p.oct;
+    for (int c0 = 0; c0 < n; c0 += SCH) {
+        int cn = n - c0 < SCH ? n - c0 : SCH;
+        float yf = y * p.freq;
+        float zf = z * p.freq;
+        for (int i = 0; i < cn; i++) {
+            xf[i] = xs[c0 + i] * p.freq;
+            sum[i] = 0.0f;
+            amp[i] = p.bound;
+        }
+        int seed = p.seed;
+        for (int o = 0; o < oct; o++) {
+            Oct(p, seed++, xf, cn, yf, zf, nz);
+            if (Fr == NbFractNone) {
+                break;
+            }
+            accum<Fr, true>(p, nz, xf, sum, amp, cn);
+            yf *= p.lac;
+            zf *= p.lac;
+        }
+        std::memcpy(out + c0, Fr == NbFractNone ? nz : sum, sizeof(float) * (size_t) cn);
+    }
+}
+
+template <O2 Oct>
+void scan2_k(const NbParams& p, const float* xs, float y, float* out, int n) {
+    switch (p.fract) {
+    case NbFractFBm:
+        scan2_f<NbFractFBm, Oct>(p, xs, y, out, n);
+        break;
+    case NbFractRidged:
+        scan2_f<NbFractRidged, Oct>(p, xs, y, out, n);
+        break;
+    case NbFractPingPong:
+        scan2_f<NbFractPingPong, Oct>(p, xs, y, out, n);
+        break;
+    default:
+        scan2_f<NbFractNone, Oct>(p, xs, y, out, n);
+        break;
+    }
+}
+
+template <O3 Oct>
+void scan3_k(const NbParams& p, const float* xs, float y, float z, float* out, int n) {
+    switch (p.fract) {
+    case NbFractFBm:
+        scan3_f<NbFractFBm, Oct>(p, xs, y, z, out, n);
+        break;
+    case NbFractRidged:
+        scan3_f<NbFractRidged, Oct>(p, xs, y, z, out, n);
+        break;
+    case NbFractPingPong:
+        scan3_f<NbFractPingPong, Oct>(p, xs, y, z, out, n);
+        break;
+    default:
+        scan3_f<NbFractNone, Oct>(p, xs, y, z, out, n);
+        break;
+    }
+}
+
+// p.type is not NbOpenSimplex2; for scan3, p.xf3 is NbXfNone. False (nothing written) when
+// the row is too fine for scanning to pay off.
+bool scan2(const NbParams& p, const float* xs, float y, float* out, int n) {
+    if (!scan_worth(p, xs, n)) {
+        return false;
+    }
+    switch (p.type) {
+    case NbPerlin:
+        scan2_k<octave2<cell_perlin2, perlin2>>(p, xs, y, out, n);
+        break;
+    case NbValueCubic:
+        scan2_k<octave2<cell_cubic2, vcubic2>>(p, xs, y, out, n);
+        break;
+    case NbCellular:
+        if (p.cdist == NbCellManhattan) {
+            scan2_k<coctave2<NbCellManhattan>>(p, xs, y, out, n);
+        } else if (p.cdist == NbCellHybrid) {
+            scan2_k<coctave2<NbCellHybrid>>(p, xs, y, out, n);
+        } else {
+            scan2_k<coctave2<NbCellEuclidean>>(p, xs, y, out, n);
+        }
+        break;
+    default:
+        scan2_k<octave2<cell_value2, value2>>(p, xs, y, out, n);
+        break;
+    }
+    return true;
+}
+
+bool scan3(const NbParams& p, const float* xs, float y, float z, float* out, int n) {
+    if (!scan_worth(p, xs, n)) {
+        return false;
+    }
+    switch (p.type) {
+    case NbPerlin:
+        scan3_k<octave3<cell_perlin3, perlin3>>(p, xs, y, z, out, n);
+        break;
+    case NbValueCubic:
+        scan3_k<octave3<cell_cubic3, vcubic3>>(p, xs, y, z, out, n);
+        break;
+    case NbCellular:
+        if (p.cdist == NbCellManhattan) {
+            scan3_k<coctave3<NbCellManhattan>>(p, xs, y, z, out, n);
+        } else if (p.cdist == NbCellHybrid) {
+            scan3_k<coctave3<NbCellHybrid>>(p, xs, y, z, out, n);
+        } else {
+            scan3_k<coctave3<NbCellEuclidean>>(p, xs, y, z, out, n);
+        }
+        break;
+    default:
+        scan3_k<octave3<cell_value3, value3>>(p, xs, y, z, out, n);
+        break;
+    }
+    return true;
+}
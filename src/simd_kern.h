@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// Settings snapshot of a FastNoiseLite instance, consumed by the vector kernels.
+struct NbParams {
+    int type = 0;
+    int seed = 0;
+    float freq = 0.0f;
+    int xf3 = 0;
+    int fract = 0;
+    int oct = 1;
+    float lac = 2.0f;
+    float gain = 0.5f;
+    float wstr = 0.0f;
+    float pp = 2.0f;
+    float bound = 1.0f;
+    float amp = 1.0f;
+    int cdist = 0;
+    int cret = 0;
+    float cjit = 1.0f;
+    const float* g2 = nullptr;
+    const float* g3 = nullptr;
+    const float* g4 = nullptr;
+    const float* r2 = nullptr;
+    const float* r3 = nullptr;
+};
+
+enum { NbOpenSimplex2, NbPerlin, NbValue, NbValueCubic, NbCellular };
+enum { NbCellEuclidean, NbCellEuclideanSq, NbCellManhattan, NbCellHybrid };
+enum { NbCellValue, NbCellDistance, NbCellDistance2, NbCellDistance2Add, NbCellDistance2Sub, NbCellDistance2Mul, NbCellDistance2Div };
+enum { NbXfNone, NbXfImproveXY, NbXfImproveXZ, NbXfOpenSimplex2 };
+enum { NbWarpOpenSimplex2, NbWarpOpenSimplex2Reduced, NbWarpBasicGrid };
+enum { NbFractNone, NbFractFBm, NbFractRidged, NbFractPingPong };
+
+// Scalar reference for one pixel of the colorize kernels: normalize, index the
+// baked lut (k = lut size - 1) and write three bytes.
+static inline int lut_px(float v, float s, float q, float o, float k) {
+    float t = (v - s) / q + o;
+    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+    int i = (int) (t * k + 0.5f);
+    return i < 0 ? 0 : (i > (int) k ? (int) k : i);
+}
+
+static inline void colorize_px(float v, float s, float q, float o, float k, const uint32_t* lut, uint8_t* d) {
+    uint32_t c = lut[lut_px(v, s, q, o, k)];
+    d[0] = (uint8_t) c;
+    d[1] = (uint8_t) (c >> 8);
+    d[2] = (uint8_t) (c >> 16);
+}
+
+void nb2_sse41(const NbParams& p, const float* xs, const float* ys, float* out, int n);
+void nb3_sse41(const NbParams& p, const float* xs, const float* ys, const float* zs, float* out, int n);
+void nb4_sse41(const NbParams& p, const float* xs, const float* ys, const float* zs, const float* ws, float* out, int n);
+bool ns2_sse41(const NbParams& p, const float* xs, float y, float* out, int n);
+bool ns3_sse41(const NbParams& p, const float* xs, float y, float z, float* out, int n);
+void nw_sse41(const NbParams& p, const float* xs, const float* ys, float* dx, float* dy, int n);
+void nb2_avx2(const NbParams& p, const float* xs, const float* ys, float* out, int n);
+void nb3_avx2(const NbParams& p, const float* xs, const float* ys, const float* zs, float* out, int n);
+void nb4_avx2(const NbParams& p, const float* xs, const float* ys, const float* zs, const float* ws, float* out, int n);
+bool ns2_avx2(const NbParams& p, const float* xs, float y, float* out, int n);
+bool ns3_avx2(const NbParams& p, const float* xs, float y, float z, float* out, int n);
+void nw_avx2(const NbParams& p, const float* xs, const float* ys, float* dx, float* dy, int n);
+void colorize_sse41(const float* v, int n, float s, float q, float o, float k, const uint32_t* lut, uint8_t* rgb);
+void colorize_avx2(const float* v, int n, float s, float q, float o, float k, const uint32_t* lut, uint8_t* rgb);
+void colorize_index_sse41(const float* v, int n, float s, float q, float o, float k, const uint32_t* ix, uint8_t* out);
+void colorize_index_avx2(const float* v, int n, float s, float q, float o, float k, const uint32_t* ix, uint8_t* out);
@@ -0,0 +1,156 @@
+#include "simd_kern.h"
+#include <smmintrin.h>
+
+namespace {
+
+constexpr int W = 4;
+
+struct M {
+    __m128 v;
+};
+
+struct F {
+    __m128 v;
+    F() = default;
+    explicit F(__m128 a) : v(a) {}
+    explicit F(float a) : v(_mm_set1_ps(a)) {}
+};
+
+struct I {
+    __m128i v;
+    I() = default;
+    explicit I(__m128i a) : v(a) {}
+    explicit I(int a) : v(_mm_set1_epi32(a)) {}
+};
+
+inline F operator+(F a, F b) { return F(_mm_add_ps(a.v, b.v)); }
+inline F operator-(F a, F b) { return F(_mm_sub_ps(a.v, b.v)); }
+inline F operator*(F a, F b) { return F(_mm_mul_ps(a.v, b.v)); }
+inline F operator/(F a, F b) { return F(_mm_div_ps(a.v, b.v)); }
+inline F operator-(F a) { return F(_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))); }
+inline M operator<(F a, F b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline M operator<=(F a, F b) { return {_mm_cmple_ps(a.v, b.v)}; }
+inline M operator>(F a, F b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline M operator>=(F a, F b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline M nge(F a, F b) { return {_mm_cmpnge_ps(a.v, b.v)}; }
+inline M operator&(M a, M b) { return {_mm_and_ps(a.v, b.v)}; }
+inline M operator|(M a, M b) { return {_mm_or_ps(a.v, b.v)}; }
+inline M operator~(M a) { return {_mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1)))}; }
+inline M andnot(M a, M b) { return {_mm_andnot_ps(a.v, b.v)}; }
+inline F min_(F a, F b) { return F(_mm_min_ps(a.v, b.v)); }
+inline F max_(F a, F b) { return F(_mm_max_ps(a.v, b.v)); }
+inline F sqrt_(F a) { return F(_mm_sqrt_ps(a.v)); }
+inline F sel(M m, F a, F b) { return F(_mm_blendv_ps(b.v, a.v, m.v)); }
+
+inline I operator+(I a, I b) { return I(_mm_add_epi32(a.v, b.v)); }
+inline I operator-(I a, I b) { return I(_mm_sub_epi32(a.v, b.v)); }
+inline I operator*(I a, I b) { return I(_mm_mullo_epi32(a.v, b.v)); }
+inline I operator^(I a, I b) { return I(_mm_xor_si128(a.v, b.v)); }
+inline I operator&(I a, I b) { return I(_mm_and_si128(a.v, b.v)); }
+inline I operator|(I a, I b) { return I(_mm_or_si128(a.v, b.v)); }
+inline I sra(I a, int n) { return I(_mm_srai_epi32(a.v, n)); }
+inline I sll(I a, int n) { return I(_mm_slli_epi32(a.v, n)); }
+inline bool all_eq(I a, I b) { return _mm_movemask_epi8(_mm_cmpeq_epi32(a.v, b.v)) == 0xFFFF; }
+inline I as_i(M m) { return I(_mm_castps_si128(m.v)); }
+inline I seli(M m, I a, I b) {
+    return I(_mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(b.v), _mm_castsi128_ps(a.v), m.v)));
+}
+
+inline F cvt(I a) { return F(_mm_cvtepi32_ps(a.v)); }
+inline I cvtt(F a) { return I(_mm_cvttps_epi32(a.v)); }
+
+inline F gather(const float* t, I i) {
+    return F(_mm_setr_ps(t[_mm_cvtsi128_si32(i.v)], t[_mm_extract_epi32(i.v, 1)], t[_mm_extract_epi32(i.v, 2)], t[_mm_extract_epi32(i.v, 3)]));
+}
+
+inline F load(const float* p, int m) {
+    if (m == W) {
+        return F(_mm_loadu_ps(p));
+    }
+    alignas(16) float b[W] = {};
+    for (int i = 0; i < m; i++) {
+        b[i] = p[i];
+    }
+    return F(_mm_load_ps(b));
+}
+
+inline void store(float* p, F v, int m) {
+    if (m == W) {
+        _mm_storeu_ps(p, v.v);
+        return;
+    }
+    alignas(16) float b[W];
+    _mm_store_ps(b, v.v);
+    for (int i = 0; i < m; i++) {
+        p[i] = b[i];
+    }
+}
+
+#include "simd_body.h"
+
+}
+
+void nb2_sse41(const NbParams& p, const float* xs, const float* ys, float* out, int n) {
+    run2(p, xs, ys, out, n);
+}
+
+void nb3_sse41(const NbParams& p, const float* xs, const float* ys, const float* zs, float* out, int n) {
+    run3(p, xs, ys, zs, out, n);
+}
+
+void nb4_sse41(const NbParams& p, const float* xs, const float* ys, const float* zs, const float* ws, float* out, int n) {
+    run4(p, xs, ys, zs, ws, out, n);
+}
+
+bool ns2_sse41(const NbParams& p, const float* xs, float y, float* out, int n) {
+    return scan2(p, xs, y, out, n);
+}
+
+bool ns3_sse41(const NbParams& p, const float* xs, float y, float z, float* out, int n) {
+    return scan3(p, xs, y, z, out, n);
+}
+
+void nw_sse41(const NbParams& p, const float* xs, const float* ys, float* dx, float* dy, int n) {
+    runw(p, xs, ys, dx, dy, n);
+}
+
+void colorize_sse41(const float* v, int n, float s, float q, float o, float k, const uint32_t* lut, uint8_t* rgb) {
+    const __m128 vs = _mm_set1_ps(s), vq = _mm_set1_ps(q), vo = _mm_set1_ps(o);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 vk = _mm_set1_ps(k), half = _mm_set1_ps(0.5f);
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 t = _mm_add_ps(_mm_div_ps(_mm_sub_ps(_mm_loadu_ps(v + i), vs), vq), vo);
+        t = _mm_min_ps(_mm_max_ps(t, zero), one);
+        __m128i idx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(t, vk), half));
+        __m128i c = _mm_setr_epi32((int) lut[_mm_cvtsi128_si32(idx)], (int) lut[_mm_extract_epi32(idx, 1)], (int) lut[_mm_extract_epi32(idx, 2)], (int) lut[_mm_extract_epi32(idx, 3)]);
+        __m128i a = _mm_shuffle_epi8(c, pack);
+        uint8_t* d = rgb + (size_t) i * 3u;
+        uint32_t ta = (uint32_t) _mm_extract_epi32(a, 2);
+        _mm_storel_epi64((__m128i*) d, a);
+        std::memcpy(d + 8, &ta, 4);
+    }
+    for (; i < n; i++) {
+        colorize_px(v[i], s, q, o, k, lut, rgb + (size_t) i * 3u);
+    }
+}
+
+void colorize_index_sse41(const float* v, int n, float s, float q, float o, float k, const uint32_t* ix, uint8_t* out) {
+    const __m128 vs = _mm_set1_ps(s), vq = _mm_set1_ps(q), vo = _mm_set1_ps(o);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 vk = _mm_set1_ps(k), half = _mm_set1_ps(0.5f);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 t = _mm_add_ps(_mm_div_ps(_mm_sub_ps(_mm_loadu_ps(v + i), vs), vq), vo);
+        t = _mm_min_ps(_mm_max_ps(t, zero), one);
+        __m128i idx = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(t, vk), half));
+        out[i] = (uint8_t) ix[_mm_cvtsi128_si32(idx)];
+        out[i + 1] = (uint8_t) ix[_mm_extract_epi32(idx, 1)];
+        out[i + 2] = (uint8_t) ix[_mm_extract_epi32(idx, 2)];
+        out[i + 3] = (uint8_t) ix[_mm_extract_epi32(idx, 3)];
+    }
+    for (; i < n; i++) {
+        out[i] = (uint8_t) ix[lut_px(v[i], s, q, o, k)];
+    }
+}
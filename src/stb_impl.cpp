@@ -1,2 +0,0 @@
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
\ No newline at end of file
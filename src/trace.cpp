@@ -0,0 +1,92 @@
+#include "trace.h"
+#include "util.h"
+#include <algorithm>
+#include <cstdio>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+double Trace::now() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Trace::add(const char* name, int tid, double t0, double px) {
+    double t1 = now();
+    std::lock_guard<std::mutex> g(m);
+    spans.push_back({name, tid, t0, t1, px});
+}
+
+std::vector<Trace::Stage> Trace::stages() const {
+    std::vector<Span> s = spans;
+    std::stable_sort(s.begin(), s.end(), [](const Span& a, const Span& b) { return a.t0 < b.t0; });
+    std::vector<Stage> r;
+    std::vector<double> end;  // end of the current wall interval per stage
+    for (const Span& p : s) {
+        size_t i = 0;
+        while (i < r.size() && r[i].name != p.name) {
+            i++;
+        }
+        if (i == r.size()) {
+            r.push_back(Stage());
+            r[i].name = p.name;
+            end.push_back(p.t0);
+        }
+        Stage& st = r[i];
+        st.busy += p.t1 - p.t0;
+        st.px += p.px;
+        st.n++;
+        // Spans come by start time, so the union grows by whatever lies past its end.
+        if (p.t1 > end[i]) {
+            st.wall += p.t1 - std::max(p.t0, end[i]);
+            end[i] = p.t1;
+        }
+    }
+    return r;
+}
+
+void Trace::write_chrome(const std::string& path) const {
+    std::string s = "{\"traceEvents\":[\n";
+    char b[256];
+    int tn = 0;
+    for (const Span& p : spans) {
+        tn = std::max(tn, p.tid + 1);
+    }
+    for (int t = 0; t < tn; t++) {
+        std::snprintf(b, sizeof b, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}},\n", t,
+                      t == 0 ? "main/worker" : "worker", t);
+        s += b;
+    }
+    for (size_t i = 0; i < spans.size(); i++) {
+        const Span& p = spans[i];
+        std::snprintf(b, sizeof b, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"px\":%.0f}}%s\n",
+                      p.name.c_str(), p.tid, p.t0 * 1e6, (p.t1 - p.t0) * 1e6, p.px, i + 1 < spans.size() ? "," : "");
+        s += b;
+    }
+    s += "]}\n";
+    write_all(path, s);
+}
+
+double peak_rss_mb() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pc;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &pc, sizeof pc)) {
+        return (double) pc.PeakWorkingSetSize / (1024.0 * 1024.0);
+    }
+    return 0.0;
+#else
+    struct rusage u;
+    if (getrusage(RUSAGE_SELF, &u) != 0) {
+        return 0.0;
+    }
+#if defined(__APPLE__)
+    return (double) u.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return (double) u.ru_maxrss / 1024.0;
+#endif
+#endif
+}
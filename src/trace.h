@@ -0,0 +1,54 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Wall-clock spans of one render by stage and worker, for --stats and --trace. Worker ids
+// are par_for slots; slot 0 is the calling thread, which also does the serial stages.
+struct Trace {
+    struct Span {
+        std::string name;
+        int tid = 0;
+        double t0 = 0.0, t1 = 0.0;  // seconds since the trace started
+        double px = 0.0;
+    };
+
+    // Totals of all spans of one name: busy is summed over workers, wall is the time at
+    // least one worker spent in the stage.
+    struct Stage {
+        std::string name;
+        double busy = 0.0, wall = 0.0, px = 0.0;
+        int n = 0;
+    };
+
+    bool on = false;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::mutex m;
+    std::vector<Span> spans;
+
+    double now() const;
+    void add(const char* name, int tid, double t0, double px);
+    // Stages in the order they first started.
+    std::vector<Stage> stages() const;
+    // Chrome trace-event JSON (chrome://tracing, Perfetto).
+    void write_chrome(const std::string& path) const;
+};
+
+// Records [construction, destruction) as a span of `px` pixels when the trace is on.
+struct Scope {
+    Trace& t;
+    const char* name;
+    int tid;
+    double px, t0;
+
+    Scope(Trace& tr, const char* n, int id, double p = 0.0) : t(tr), name(n), tid(id), px(p), t0(tr.on ? tr.now() : 0.0) {}
+    ~Scope() {
+        if (t.on) {
+            t.add(name, tid, t0, px);
+        }
+    }
+};
+
+// Peak resident set size of the process in MiB (0 where unknown).
+double peak_rss_mb();
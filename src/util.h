@@ -98,6 +98,21 @@ static inline bool parse_i(const std::string& s, int& x) {
     return true;
 }
 
+// Decimal digits only: strtoull would also take a sign and wrap a negative value.
+static inline bool parse_u64(const std::string& s, uint64_t& x) {
+    if (s.empty() || !std::isdigit((unsigned char) s[0])) {
+        return false;
+    }
+    errno = 0;
+    char* e = nullptr;
+    unsigned long long v = std::strtoull(s.c_str(), &e, 10);
+    if (errno != 0 || *e != '\0') {
+        return false;
+    }
+    x = (uint64_t) v;
+    return true;
+}
+
 static inline bool parse_f(const std::string& s, float& x) {
     errno = 0;
     char* e = nullptr;
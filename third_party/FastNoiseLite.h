@@ -338,6 +338,40 @@ public:
         }
     }
 
+    /// <summary>
+    /// 4D noise at given position using current settings
+    /// </summary>
+    /// <remarks>
+    /// Local addition, used for seamless tiling on a 4D torus. OpenSimplex2 and OpenSimplex2S
+    /// both evaluate 4D simplex noise; Perlin and Value extend their 3D versions. Frequency is
+    /// applied but no 3D rotation. Other noise types return 0.
+    /// </remarks>
+    /// <returns>
+    /// Noise output bounded between -1...1
+    /// </returns>
+    template <typename FNfloat>
+    float GetNoise(FNfloat x, FNfloat y, FNfloat z, FNfloat w) const
+    {
+        Arguments_must_be_floating_point_values<FNfloat>();
+
+        x *= mFrequency;
+        y *= mFrequency;
+        z *= mFrequency;
+        w *= mFrequency;
+
+        switch (mFractalType)
+        {
+        default:
+            return GenNoiseSingle(mSeed, x, y, z, w);
+        case FractalType_FBm:
+            return GenFractalFBm(x, y, z, w);
+        case FractalType_Ridged:
+            return GenFractalRidged(x, y, z, w);
+        case FractalType_PingPong:
+            return GenFractalPingPong(x, y, z, w);
+        }
+    }
+
 
     /// <summary>
     /// 2D warps the input position using current domain warp settings
@@ -394,6 +428,9 @@ public:
     }
 
 private:
+    // Local addition: batched evaluation in src/simd.cpp reads the settings and lookup tables.
+    friend struct NoiseBatch;
+
     template <typename T>
     struct Arguments_must_be_floating_point_values;
 
@@ -434,6 +471,7 @@ private:
     {
         static const T Gradients2D[];
         static const T Gradients3D[];
+        static const T Gradients4D[]; // Local addition
         static const T RandVecs2D[];
         static const T RandVecs3D[];
     };
@@ -1622,9 +1660,12 @@ private:
 
         float cellularJitter = 0.39614353f * mCellularJitterModifier;
 
-        int xPrimed = (xr - 1) * PrimeX;
-        int yPrimedBase = (yr - 1) * PrimeY;
-        int zPrimedBase = (zr - 1) * PrimeZ;
+        // Local change: the primed coordinates are stepped in unsigned arithmetic. The signed
+        // products and sums wrap for most cells, and GCC infers from that overflow that the z
+        // loops stop early (-Waggressive-loop-optimizations); the bits are the same.
+        unsigned xPrimed = (unsigned) (xr - 1) * (unsigned) PrimeX;
+        unsigned yPrimedBase = (unsigned) (yr - 1) * (unsigned) PrimeY;
+        unsigned zPrimedBase = (unsigned) (zr - 1) * (unsigned) PrimeZ;
 
         switch (mCellularDistanceFunction)
         {
@@ -1632,15 +1673,15 @@ private:
         case CellularDistanceFunction_EuclideanSq:
             for (int xi = xr - 1; xi <= xr + 1; xi++)
             {
-                int yPrimed = yPrimedBase;
+                unsigned yPrimed = yPrimedBase;
 
                 for (int yi = yr - 1; yi <= yr + 1; yi++)
                 {
-                    int zPrimed = zPrimedBase;
+                    unsigned zPrimed = zPrimedBase;
 
                     for (int zi = zr - 1; zi <= zr + 1; zi++)
                     {
-                        int hash = Hash(seed, xPrimed, yPrimed, zPrimed);
+                        int hash = Hash(seed, (int) xPrimed, (int) yPrimed, (int) zPrimed);
                         int idx = hash & (255 << 2);
 
                         float vecX = (float)(xi - x) + Lookup<float>::RandVecs3D[idx] * cellularJitter;
@@ -1655,25 +1696,25 @@ private:
                             distance0 = newDistance;
                             closestHash = hash;
                         }
-                        zPrimed += PrimeZ;
+                        zPrimed += (unsigned) PrimeZ;
                     }
-                    yPrimed += PrimeY;
+                    yPrimed += (unsigned) PrimeY;
                 }
-                xPrimed += PrimeX;
+                xPrimed += (unsigned) PrimeX;
             }
             break;
         case CellularDistanceFunction_Manhattan:
             for (int xi = xr - 1; xi <= xr + 1; xi++)
             {
-                int yPrimed = yPrimedBase;
+                unsigned yPrimed = yPrimedBase;
 
                 for (int yi = yr - 1; yi <= yr + 1; yi++)
                 {
-                    int zPrimed = zPrimedBase;
+                    unsigned zPrimed = zPrimedBase;
 
                     for (int zi = zr - 1; zi <= zr + 1; zi++)
                     {
-                        int hash = Hash(seed, xPrimed, yPrimed, zPrimed);
+                        int hash = Hash(seed, (int) xPrimed, (int) yPrimed, (int) zPrimed);
                         int idx = hash & (255 << 2);
 
                         float vecX = (float)(xi - x) + Lookup<float>::RandVecs3D[idx] * cellularJitter;
@@ -1688,25 +1729,25 @@ private:
                             distance0 = newDistance;
                             closestHash = hash;
                         }
-                        zPrimed += PrimeZ;
+                        zPrimed += (unsigned) PrimeZ;
                     }
-                    yPrimed += PrimeY;
+                    yPrimed += (unsigned) PrimeY;
                 }
-                xPrimed += PrimeX;
+                xPrimed += (unsigned) PrimeX;
             }
             break;
         case CellularDistanceFunction_Hybrid:
             for (int xi = xr - 1; xi <= xr + 1; xi++)
             {
-                int yPrimed = yPrimedBase;
+                unsigned yPrimed = yPrimedBase;
 
                 for (int yi = yr - 1; yi <= yr + 1; yi++)
                 {
-                    int zPrimed = zPrimedBase;
+                    unsigned zPrimed = zPrimedBase;
 
                     for (int zi = zr - 1; zi <= zr + 1; zi++)
                     {
-                        int hash = Hash(seed, xPrimed, yPrimed, zPrimed);
+                        int hash = Hash(seed, (int) xPrimed, (int) yPrimed, (int) zPrimed);
                         int idx = hash & (255 << 2);
 
                         float vecX = (float)(xi - x) + Lookup<float>::RandVecs3D[idx] * cellularJitter;
@@ -1721,11 +1762,11 @@ private:
                             distance0 = newDistance;
                             closestHash = hash;
                         }
-                        zPrimed += PrimeZ;
+                        zPrimed += (unsigned) PrimeZ;
                     }
-                    yPrimed += PrimeY;
+                    yPrimed += (unsigned) PrimeY;
                 }
-                xPrimed += PrimeX;
+                xPrimed += (unsigned) PrimeX;
             }
             break;
         default:
@@ -1967,6 +2008,281 @@ private:
     }
 
 
+    // Local addition: 4D noise behind GetNoise(x, y, z, w)
+
+    static const int PrimeW = 1066037191;
+
+    static int Hash(int seed, int xPrimed, int yPrimed, int zPrimed, int wPrimed)
+    {
+        int hash = seed ^ xPrimed ^ yPrimed ^ zPrimed ^ wPrimed;
+
+        hash *= 0x27d4eb2d;
+        return hash;
+    }
+
+
+    static float ValCoord(int seed, int xPrimed, int yPrimed, int zPrimed, int wPrimed)
+    {
+        int hash = Hash(seed, xPrimed, yPrimed, zPrimed, wPrimed);
+
+        hash *= hash;
+        hash ^= hash << 19;
+        return hash * (1 / 2147483648.0f);
+    }
+
+
+    float GradCoord(int seed, int xPrimed, int yPrimed, int zPrimed, int wPrimed, float xd, float yd, float zd, float wd) const
+    {
+        int hash = Hash(seed, xPrimed, yPrimed, zPrimed, wPrimed);
+        hash ^= hash >> 15;
+        hash &= 63 << 2;
+
+        float xg = Lookup<float>::Gradients4D[hash];
+        float yg = Lookup<float>::Gradients4D[hash | 1];
+        float zg = Lookup<float>::Gradients4D[hash | 2];
+        float wg = Lookup<float>::Gradients4D[hash | 3];
+
+        return xd * xg + yd * yg + zd * zg + wd * wg;
+    }
+
+
+    template <typename FNfloat>
+    float GenNoiseSingle(int seed, FNfloat x, FNfloat y, FNfloat z, FNfloat w) const
+    {
+        switch (mNoiseType)
+        {
+        case NoiseType_OpenSimplex2:
+        case NoiseType_OpenSimplex2S:
+            return SingleSimplex(seed, x, y, z, w);
+        case NoiseType_Perlin:
+            return SinglePerlin(seed, x, y, z, w);
+        case NoiseType_Value:
+            return SingleValue(seed, x, y, z, w);
+        default:
+            return 0;
+        }
+    }
+
+
+    template <typename FNfloat>
+    float GenFractalFBm(FNfloat x, FNfloat y, FNfloat z, FNfloat w) const
+    {
+        int seed = mSeed;
+        float sum = 0;
+        float amp = mFractalBounding;
+
+        for (int i = 0; i < mOctaves; i++)
+        {
+            float noise = GenNoiseSingle(seed++, x, y, z, w);
+            sum += noise * amp;
+            amp *= Lerp(1.0f, (noise + 1) * 0.5f, mWeightedStrength);
+
+            x *= mLacunarity;
+            y *= mLacunarity;
+            z *= mLacunarity;
+            w *= mLacunarity;
+            amp *= mGain;
+        }
+
+        return sum;
+    }
+
+
+    template <typename FNfloat>
+    float GenFractalRidged(FNfloat x, FNfloat y, FNfloat z, FNfloat w) const
+    {
+        int seed = mSeed;
+        float sum = 0;
+        float amp = mFractalBounding;
+
+        for (int i = 0; i < mOctaves; i++)
+        {
+            float noise = FastAbs(GenNoiseSingle(seed++, x, y, z, w));
+            sum += (noise * -2 + 1) * amp;
+            amp *= Lerp(1.0f, 1 - noise, mWeightedStrength);
+
+            x *= mLacunarity;
+            y *= mLacunarity;
+            z *= mLacunarity;
+            w *= mLacunarity;
+            amp *= mGain;
+        }
+
+        return sum;
+    }
+
+
+    template <typename FNfloat>
+    float GenFractalPingPong(FNfloat x, FNfloat y, FNfloat z, FNfloat w) const
+    {
+        int seed = mSeed;
+        float sum = 0;
+        float amp = mFractalBounding;
+
+        for (int i = 0; i < mOctaves; i++)
+        {
+            float noise = PingPong((GenNoiseSingle(seed++, x, y, z, w) + 1) * mPingPongStrength);
+            sum += (noise - 0.5f) * 2 * amp;
+            amp *= Lerp(1.0f, noise, mWeightedStrength);
+
+            x *= mLacunarity;
+            y *= mLacunarity;
+            z *= mLacunarity;
+            w *= mLacunarity;
+            amp *= mGain;
+        }
+
+        return sum;
+    }
+
+
+    // 4D simplex noise: skew to the simplex lattice, rank the axes to find the enclosing
+    // simplex, then sum the five corner contributions.
+    template <typename FNfloat>
+    float SingleSimplex(int seed, FNfloat x, FNfloat y, FNfloat z, FNfloat w) const
+    {
+        const float F4 = 0.309016994374947424f;
+        const float G4 = 0.138196601125010515f;
+
+        float s = (float)(x + y + z + w) * F4;
+        int i = FastFloor((float)x + s);
+        int j = FastFloor((float)y + s);
+        int k = FastFloor((float)z + s);
+        int l = FastFloor((float)w + s);
+
+        float t = (float)(i + j + k + l) * G4;
+        float x0 = ((float)x - (float)i) + t;
+        float y0 = ((float)y - (float)j) + t;
+        float z0 = ((float)z - (float)k) + t;
+        float w0 = ((float)w - (float)l) + t;
+
+        int rx = (x0 > y0) + (x0 > z0) + (x0 > w0);
+        int ry = (y0 >= x0) + (y0 > z0) + (y0 > w0);
+        int rz = (z0 >= x0) + (z0 >= y0) + (z0 > w0);
+        int rw = (w0 >= x0) + (w0 >= y0) + (w0 >= z0);
+
+        i *= PrimeX;
+        j *= PrimeY;
+        k *= PrimeZ;
+        l *= PrimeW;
+
+        float n = 0;
+        for (int c = 0; c < 5; c++)
+        {
+            int ox = rx >= 4 - c;
+            int oy = ry >= 4 - c;
+            int oz = rz >= 4 - c;
+            int ow = rw >= 4 - c;
+            float g = G4 * c;
+            float xc = (x0 - (float)ox) + g;
+            float yc = (y0 - (float)oy) + g;
+            float zc = (z0 - (float)oz) + g;
+            float wc = (w0 - (float)ow) + g;
+            float a = (((0.6f - xc * xc) - yc * yc) - zc * zc) - wc * wc;
+            float v = 0;
+            if (a > 0)
+            {
+                v = (a * a) * (a * a) * GradCoord(seed, i + (ox ? PrimeX : 0), j + (oy ? PrimeY : 0), k + (oz ? PrimeZ : 0), l + (ow ? PrimeW : 0), xc, yc, zc, wc);
+            }
+            n += v;
+        }
+
+        return n * 27.0f;
+    }
+
+
+    template <typename FNfloat>
+    float SinglePerlin(int seed, FNfloat x, FNfloat y, FNfloat z, FNfloat w) const
+    {
+        int x0 = FastFloor(x);
+        int y0 = FastFloor(y);
+        int z0 = FastFloor(z);
+        int w0 = FastFloor(w);
+
+        float xd0 = (float)(x - x0);
+        float yd0 = (float)(y - y0);
+        float zd0 = (float)(z - z0);
+        float wd0 = (float)(w - w0);
+        float xd1 = xd0 - 1;
+        float yd1 = yd0 - 1;
+        float zd1 = zd0 - 1;
+        float wd1 = wd0 - 1;
+
+        float xs = InterpQuintic(xd0);
+        float ys = InterpQuintic(yd0);
+        float zs = InterpQuintic(zd0);
+        float ws = InterpQuintic(wd0);
+
+        x0 *= PrimeX;
+        y0 *= PrimeY;
+        z0 *= PrimeZ;
+        w0 *= PrimeW;
+        int x1 = x0 + PrimeX;
+        int y1 = y0 + PrimeY;
+        int z1 = z0 + PrimeZ;
+        int w1 = w0 + PrimeW;
+
+        float wf[2];
+        for (int d = 0; d < 2; d++)
+        {
+            int wp = d ? w1 : w0;
+            float wd = d ? wd1 : wd0;
+            float xf00 = Lerp(GradCoord(seed, x0, y0, z0, wp, xd0, yd0, zd0, wd), GradCoord(seed, x1, y0, z0, wp, xd1, yd0, zd0, wd), xs);
+            float xf10 = Lerp(GradCoord(seed, x0, y1, z0, wp, xd0, yd1, zd0, wd), GradCoord(seed, x1, y1, z0, wp, xd1, yd1, zd0, wd), xs);
+            float xf01 = Lerp(GradCoord(seed, x0, y0, z1, wp, xd0, yd0, zd1, wd), GradCoord(seed, x1, y0, z1, wp, xd1, yd0, zd1, wd), xs);
+            float xf11 = Lerp(GradCoord(seed, x0, y1, z1, wp, xd0, yd1, zd1, wd), GradCoord(seed, x1, y1, z1, wp, xd1, yd1, zd1, wd), xs);
+
+            float yf0 = Lerp(xf00, xf10, ys);
+            float yf1 = Lerp(xf01, xf11, ys);
+
+            wf[d] = Lerp(yf0, yf1, zs);
+        }
+
+        return Lerp(wf[0], wf[1], ws) * 0.83f;
+    }
+
+
+    template <typename FNfloat>
+    float SingleValue(int seed, FNfloat x, FNfloat y, FNfloat z, FNfloat w) const
+    {
+        int x0 = FastFloor(x);
+        int y0 = FastFloor(y);
+        int z0 = FastFloor(z);
+        int w0 = FastFloor(w);
+
+        float xs = InterpHermite((float)(x - x0));
+        float ys = InterpHermite((float)(y - y0));
+        float zs = InterpHermite((float)(z - z0));
+        float ws = InterpHermite((float)(w - w0));
+
+        x0 *= PrimeX;
+        y0 *= PrimeY;
+        z0 *= PrimeZ;
+        w0 *= PrimeW;
+        int x1 = x0 + PrimeX;
+        int y1 = y0 + PrimeY;
+        int z1 = z0 + PrimeZ;
+        int w1 = w0 + PrimeW;
+
+        float wf[2];
+        for (int d = 0; d < 2; d++)
+        {
+            int wp = d ? w1 : w0;
+            float xf00 = Lerp(ValCoord(seed, x0, y0, z0, wp), ValCoord(seed, x1, y0, z0, wp), xs);
+            float xf10 = Lerp(ValCoord(seed, x0, y1, z0, wp), ValCoord(seed, x1, y1, z0, wp), xs);
+            float xf01 = Lerp(ValCoord(seed, x0, y0, z1, wp), ValCoord(seed, x1, y0, z1, wp), xs);
+            float xf11 = Lerp(ValCoord(seed, x0, y1, z1, wp), ValCoord(seed, x1, y1, z1, wp), xs);
+
+            float yf0 = Lerp(xf00, xf10, ys);
+            float yf1 = Lerp(xf01, xf11, ys);
+
+            wf[d] = Lerp(yf0, yf1, zs);
+        }
+
+        return Lerp(wf[0], wf[1], ws);
+    }
+
+
     // Domain Warp
 
     template <typename FNfloat>
@@ -2546,6 +2862,28 @@ const T FastNoiseLite::Lookup<T>::Gradients3D[] =
     1, 1, 0, 0,  0,-1, 1, 0, -1, 1, 0, 0,  0,-1,-1, 0
 };
 
+// Local addition: the 32 edge midpoints of the 4D hypercube, twice.
+template <typename T>
+const T FastNoiseLite::Lookup<T>::Gradients4D[] =
+{
+     0, 1, 1, 1,  0, 1, 1,-1,  0, 1,-1, 1,  0, 1,-1,-1,
+     0,-1, 1, 1,  0,-1, 1,-1,  0,-1,-1, 1,  0,-1,-1,-1,
+     1, 0, 1, 1,  1, 0, 1,-1,  1, 0,-1, 1,  1, 0,-1,-1,
+    -1, 0, 1, 1, -1, 0, 1,-1, -1, 0,-1, 1, -1, 0,-1,-1,
+     1, 1, 0, 1,  1, 1, 0,-1,  1,-1, 0, 1,  1,-1, 0,-1,
+    -1, 1, 0, 1, -1, 1, 0,-1, -1,-1, 0, 1, -1,-1, 0,-1,
+     1, 1, 1, 0,  1, 1,-1, 0,  1,-1, 1, 0,  1,-1,-1, 0,
+    -1, 1, 1, 0, -1, 1,-1, 0, -1,-1, 1, 0, -1,-1,-1, 0,
+     0, 1, 1, 1,  0, 1, 1,-1,  0, 1,-1, 1,  0, 1,-1,-1,
+     0,-1, 1, 1,  0,-1, 1,-1,  0,-1,-1, 1,  0,-1,-1,-1,
+     1, 0, 1, 1,  1, 0, 1,-1,  1, 0,-1, 1,  1, 0,-1,-1,
+    -1, 0, 1, 1, -1, 0, 1,-1, -1, 0,-1, 1, -1, 0,-1,-1,
+     1, 1, 0, 1,  1, 1, 0,-1,  1,-1, 0, 1,  1,-1, 0,-1,
+    -1, 1, 0, 1, -1, 1, 0,-1, -1,-1, 0, 1, -1,-1, 0,-1,
+     1, 1, 1, 0,  1, 1,-1, 0,  1,-1, 1, 0,  1,-1,-1, 0,
+    -1, 1, 1, 0, -1, 1,-1, 0, -1,-1, 1, 0, -1,-1,-1, 0
+};
+
 template <typename T>
 const T FastNoiseLite::Lookup<T>::RandVecs3D[] =
 {